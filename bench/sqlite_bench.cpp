@@ -0,0 +1,463 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "../sqlite_statement.h"
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+namespace
+{
+	struct Config
+	{
+		size_t rows = 100000;
+		size_t commits = 1000;
+		size_t threads = 4;
+		bool memory = true;
+		bool disk = true;
+		std::string diskFile = "sqlite_bench.db";
+		std::string output;
+		std::string filter;
+	};
+
+	struct Result
+	{
+		std::string name;
+		std::string database;
+		size_t operations;
+		double seconds;
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	class Bench
+	{
+	public:
+		Bench(const Config & config, std::ostream * output) : m_Config(config), m_Output(output) {}
+
+		void run(const char * database);
+
+	private:
+		const Config & m_Config;
+		std::ostream * m_Output;
+		std::string m_DatabaseName;
+		std::string m_DatabaseFile;
+
+		template <class FUNC> void measure(const char * name, size_t operations, FUNC && body);
+		void report(const Result & result);
+
+		void prepareTable(SQLiteDatabase & db, const char * name);
+		void fillTable(SQLiteDatabase & db, size_t rows);
+
+		void benchAdHocExec(SQLiteDatabase & db);
+		void benchReusedStatement(SQLiteDatabase & db);
+		void benchBindTypes(SQLiteDatabase & db);
+		void benchRowIteration(SQLiteDatabase & db);
+		void benchTransactions(SQLiteDatabase & db);
+		void benchNestedTransactions(SQLiteDatabase & db);
+		void benchLockerContention(SQLiteDatabase & db);
+	};
+
+	template <class FUNC> void Bench::measure(const char * name, size_t operations, FUNC && body)
+	{
+		if (!m_Config.filter.empty() && !strstr(name, m_Config.filter.c_str()))
+			return;
+
+		Clock::time_point start = Clock::now();
+		body();
+		std::chrono::duration<double> elapsed = Clock::now() - start;
+
+		Result result;
+		result.name = name;
+		result.database = m_DatabaseName;
+		result.operations = operations;
+		result.seconds = elapsed.count();
+		report(result);
+	}
+
+	void Bench::report(const Result & result)
+	{
+		double opsPerSecond = (result.seconds > 0.0 ? double(result.operations) / result.seconds : 0.0);
+
+		std::cerr << std::left << std::setw(28) << result.name << std::setw(8) << result.database << std::right
+			<< std::setw(10) << result.operations << " ops" << std::fixed << std::setprecision(3)
+			<< std::setw(10) << result.seconds * 1000.0 << " ms" << std::setprecision(0)
+			<< std::setw(14) << opsPerSecond << " ops/s" << std::endl;
+
+		// One JSON object per line
+		if (m_Output)
+		{
+			*m_Output << "{\"benchmark\":\"" << result.name << "\",\"database\":\"" << result.database
+				<< "\",\"operations\":" << result.operations << ",\"seconds\":" << std::setprecision(9)
+				<< result.seconds << ",\"opsPerSecond\":" << uint64_t(opsPerSecond + 0.5)
+				<< ",\"rows\":" << m_Config.rows << ",\"threads\":" << m_Config.threads << "}" << std::endl;
+		}
+	}
+
+	void Bench::prepareTable(SQLiteDatabase & db, const char * name)
+	{
+		db.exec(std::string("DROP TABLE IF EXISTS ") + name);
+		db.exec(std::string("CREATE TABLE ") + name + " (id INTEGER PRIMARY KEY, i INTEGER, d REAL, t TEXT, b BLOB)");
+	}
+
+	void Bench::fillTable(SQLiteDatabase & db, size_t rows)
+	{
+		prepareTable(db, "rows");
+		SQLiteStatement stmt(db, "INSERT INTO rows (i, d, t, b) VALUES (?, ?, ?, ?)");
+		size_t row = 0;
+		stmt.execBatch([&row, rows](const SQLiteStatement & stmt) {
+			if (row >= rows)
+				return false;
+			static const char text[] = "the quick brown fox jumps over the lazy dog";
+			stmt.bindInt64(1, sqlite3_int64(row));
+			stmt.bindDouble(2, double(row) * 0.5);
+			stmt.bindStaticText(3, text, sizeof(text) - 1);
+			stmt.bindStaticBlob(4, text, 16);
+			++row;
+			return true;
+		});
+	}
+
+	void Bench::benchAdHocExec(SQLiteDatabase & db)
+	{
+		prepareTable(db, "adhoc");
+		db.flushStatementCache();
+		measure("exec_adhoc_insert", m_Config.rows, [this, &db]() {
+			db.transaction([this, &db]() {
+				for (size_t i = 0; i < m_Config.rows; i++)
+					db.exec("INSERT INTO adhoc (i, d, t) VALUES (" + std::to_string(i) + ", 1.5, 'text')");
+			});
+		});
+
+		prepareTable(db, "adhoc");
+		measure("exec_cached_insert", m_Config.rows, [this, &db]() {
+			db.transaction([this, &db]() {
+				for (size_t i = 0; i < m_Config.rows; i++)
+					db.exec("INSERT INTO adhoc (i, d, t) VALUES (1, 1.5, 'text')");
+			});
+		});
+	}
+
+	void Bench::benchReusedStatement(SQLiteDatabase & db)
+	{
+		prepareTable(db, "reused");
+		measure("statement_reused_insert", m_Config.rows, [this, &db]() {
+			SQLiteStatement stmt(db, "INSERT INTO reused (i, d, t) VALUES (?, 1.5, 'text')");
+			db.transaction([this, &stmt]() {
+				for (size_t i = 0; i < m_Config.rows; i++)
+				{
+					stmt.bindInt64(1, sqlite3_int64(i));
+					stmt.exec();
+				}
+			});
+		});
+
+		prepareTable(db, "reused");
+		measure("statement_exec_batch", m_Config.rows, [this, &db]() {
+			SQLiteStatement stmt(db, "INSERT INTO reused (i, d, t) VALUES (?, 1.5, 'text')");
+			size_t row = 0;
+			stmt.execBatch([this, &row](const SQLiteStatement & stmt) {
+				if (row >= m_Config.rows)
+					return false;
+				stmt.bindInt64(1, sqlite3_int64(row++));
+				return true;
+			});
+		});
+	}
+
+	void Bench::benchBindTypes(SQLiteDatabase & db)
+	{
+		static const char text[] = "the quick brown fox jumps over the lazy dog";
+		std::string string(text);
+		SQLiteStatement stmt(db, "SELECT ?");
+		size_t n = m_Config.rows;
+
+		measure("bind_null", n, [&]() { for (size_t i = 0; i < n; i++) { stmt.bindNull(1); stmt.exec(); } });
+		measure("bind_int", n, [&]() { for (size_t i = 0; i < n; i++) { stmt.bindInt(1, int(i)); stmt.exec(); } });
+		measure("bind_int64", n, [&]() {
+			for (size_t i = 0; i < n; i++) { stmt.bindInt64(1, sqlite3_int64(i) << 32); stmt.exec(); }
+		});
+		measure("bind_double", n, [&]() {
+			for (size_t i = 0; i < n; i++) { stmt.bindDouble(1, double(i) * 0.25); stmt.exec(); }
+		});
+		measure("bind_text", n, [&]() {
+			for (size_t i = 0; i < n; i++) { stmt.bindText(1, text, sizeof(text) - 1); stmt.exec(); }
+		});
+		measure("bind_static_text", n, [&]() {
+			for (size_t i = 0; i < n; i++) { stmt.bindStaticText(1, text, sizeof(text) - 1); stmt.exec(); }
+		});
+		measure("bind_string", n, [&]() { for (size_t i = 0; i < n; i++) { stmt.bindString(1, string); stmt.exec(); } });
+		measure("bind_blob", n, [&]() {
+			for (size_t i = 0; i < n; i++) { stmt.bindBlob(1, text, sizeof(text)); stmt.exec(); }
+		});
+		measure("bind_value_traits", n, [&]() {
+			for (size_t i = 0; i < n; i++) { stmt.bindValue(1, string); stmt.exec(); }
+		});
+	}
+
+	void Bench::benchRowIteration(SQLiteDatabase & db)
+	{
+		fillTable(db, m_Config.rows);
+
+		volatile sqlite3_int64 sink = 0;
+		measure("rows_exec_callback", m_Config.rows, [&]() {
+			db.exec("SELECT i, d, t, b FROM rows", [&sink](const SQLiteCursor & cursor) {
+				sink = sink + cursor.toInt64(0) + sqlite3_int64(cursor.toDouble(1))
+					+ sqlite3_int64(cursor.toText(2)[0]) + sqlite3_int64(cursor.columnBytes(3));
+			});
+		});
+
+		measure("rows_statement_range", m_Config.rows, [&]() {
+			SQLiteStatement stmt(db, "SELECT i, d, t, b FROM rows");
+			for (const SQLiteCursor & cursor : stmt.rows())
+				sink = sink + cursor.toInt64(0) + sqlite3_int64(cursor.toDouble(1))
+					+ sqlite3_int64(cursor.toText(2)[0]) + sqlite3_int64(cursor.columnBytes(3));
+		});
+
+		measure("rows_fetch_batches", m_Config.rows, [&]() {
+			db.fetchBatches("SELECT i, d, t, b FROM rows", [&sink](const SQLiteRowBatch & batch) {
+				for (size_t i = 0; i < batch.numRows(); i++)
+					sink = sink + batch.toInt64(i, 0);
+			});
+		});
+
+		measure("rows_result_set", m_Config.rows, [&]() {
+			SQLiteResultSet result;
+			db.exec("SELECT i, d, t, b FROM rows", result);
+			sink = sink + sqlite3_int64(result.numRows());
+		});
+	}
+
+	void Bench::benchTransactions(SQLiteDatabase & db)
+	{
+		prepareTable(db, "commits");
+		measure("transaction_commit", m_Config.commits, [this, &db]() {
+			for (size_t i = 0; i < m_Config.commits; i++)
+				db.transaction([&db]() { db.exec("INSERT INTO commits (i) VALUES (1)"); });
+		});
+
+		measure("transaction_rollback", m_Config.commits, [this, &db]() {
+			for (size_t i = 0; i < m_Config.commits; i++)
+			{
+				try
+				{
+					db.transaction([&db]() {
+						db.exec("INSERT INTO commits (i) VALUES (1)");
+						throw std::runtime_error("rollback");
+					});
+				}
+				catch (const std::runtime_error &)
+				{
+				}
+			}
+		});
+	}
+
+	void Bench::benchNestedTransactions(SQLiteDatabase & db)
+	{
+		prepareTable(db, "nested");
+		measure("transaction_nested", m_Config.rows, [this, &db]() {
+			db.transaction([this, &db]() {
+				for (size_t i = 0; i < m_Config.rows; i++)
+					db.transaction([&db]() { db.exec("INSERT INTO nested (i) VALUES (1)"); });
+			});
+		});
+
+		measure("transaction_nested_depth4", m_Config.rows, [this, &db]() {
+			db.transaction([this, &db]() {
+				for (size_t i = 0; i < m_Config.rows; i++)
+				{
+					db.transaction([&db]() {
+						db.transaction([&db]() {
+							db.transaction([&db]() { db.exec("INSERT INTO nested (i) VALUES (1)"); });
+						});
+					});
+				}
+			});
+		});
+	}
+
+	void Bench::benchLockerContention(SQLiteDatabase & db)
+	{
+		size_t numThreads = std::max<size_t>(m_Config.threads, 1);
+		size_t perThread = m_Config.rows / numThreads;
+		measure("locker_contention", perThread * numThreads, [&db, numThreads, perThread]() {
+			std::vector<std::thread> threads;
+			for (size_t t = 0; t < numThreads; t++)
+			{
+				threads.emplace_back([&db, perThread]() {
+					SQLiteStatement stmt(db, "SELECT ?");
+					for (size_t i = 0; i < perThread; i++)
+					{
+						stmt.bindInt64(1, sqlite3_int64(i));
+						stmt.exec([](const SQLiteCursor &) {});
+					}
+				});
+			}
+			for (std::thread & thread : threads)
+				thread.join();
+		});
+	}
+
+	void Bench::run(const char * database)
+	{
+		m_DatabaseName = database;
+		if (m_DatabaseName == "memory")
+			m_DatabaseFile = ":memory:";
+		else
+		{
+			m_DatabaseFile = m_Config.diskFile;
+			remove(m_DatabaseFile.c_str());
+			remove((m_DatabaseFile + "-wal").c_str());
+			remove((m_DatabaseFile + "-shm").c_str());
+		}
+
+		{
+			SQLiteOpenOptions options;
+			if (m_DatabaseName != "memory")
+			{
+				options.journalMode = SQLiteOpenOptions::JournalWAL;
+				options.synchronous = SQLiteOpenOptions::SynchronousNormal;
+			}
+
+			SQLiteDatabase db(m_DatabaseFile, options);
+			benchAdHocExec(db);
+			benchReusedStatement(db);
+			benchBindTypes(db);
+			benchRowIteration(db);
+			benchTransactions(db);
+			benchNestedTransactions(db);
+			benchLockerContention(db);
+		}
+
+		if (m_DatabaseName != "memory")
+		{
+			remove(m_DatabaseFile.c_str());
+			remove((m_DatabaseFile + "-wal").c_str());
+			remove((m_DatabaseFile + "-shm").c_str());
+		}
+	}
+
+	void usage(const char * program)
+	{
+		std::cerr << "usage: " << program << " [options]\n"
+			"  --rows N         number of rows/operations per benchmark (default 100000)\n"
+			"  --commits N      number of separate transactions to commit (default 1000)\n"
+			"  --threads N      number of threads for the contention benchmark (default 4)\n"
+			"  --db KIND        memory, disk or both (default both)\n"
+			"  --file PATH      database file for on-disk runs (default sqlite_bench.db)\n"
+			"  --filter TEXT    run only benchmarks with TEXT in their names\n"
+			"  --output PATH    append results as JSON lines to PATH ('-' for stdout)\n";
+	}
+
+	size_t parseCount(const char * option, const char * value)
+	{
+		char * end = nullptr;
+		unsigned long long count = strtoull(value, &end, 10);
+		if (!*value || *end || count == 0)
+			throw std::runtime_error(std::string("invalid value for ") + option + ": " + value);
+		return size_t(count);
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	try
+	{
+		Config config;
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "--help" || arg == "-h")
+			{
+				usage(argv[0]);
+				return 0;
+			}
+			if (i + 1 >= argc)
+			{
+				usage(argv[0]);
+				return 1;
+			}
+
+			const char * value = argv[++i];
+			if (arg == "--rows")
+				config.rows = parseCount("--rows", value);
+			else if (arg == "--commits")
+				config.commits = parseCount("--commits", value);
+			else if (arg == "--threads")
+				config.threads = parseCount("--threads", value);
+			else if (arg == "--file")
+				config.diskFile = value;
+			else if (arg == "--filter")
+				config.filter = value;
+			else if (arg == "--output")
+				config.output = value;
+			else if (arg == "--db")
+			{
+				std::string kind = value;
+				config.memory = (kind == "memory" || kind == "both");
+				config.disk = (kind == "disk" || kind == "both");
+				if (!config.memory && !config.disk)
+					throw std::runtime_error("invalid value for --db: " + kind);
+			}
+			else
+			{
+				usage(argv[0]);
+				return 1;
+			}
+		}
+
+		std::ofstream file;
+		std::ostream * output = nullptr;
+		if (config.output == "-")
+			output = &std::cout;
+		else if (!config.output.empty())
+		{
+			file.open(config.output.c_str(), std::ios::out | std::ios::app);
+			if (!file)
+				throw std::runtime_error("unable to open output file '" + config.output + "'.");
+			output = &file;
+		}
+
+		Bench bench(config, output);
+		if (config.memory)
+			bench.run("memory");
+		if (config.disk)
+			bench.run("disk");
+	}
+	catch (const std::exception & e)
+	{
+		std::cerr << "error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
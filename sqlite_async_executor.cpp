@@ -0,0 +1,208 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_async_executor.h"
+#include "sqlite_clock.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <stdexcept>
+#include <cstring>
+
+SQLiteAsyncExecutor::SQLiteAsyncExecutor(SQLiteDatabase & database, size_t queueCapacity, size_t readBurst)
+	: m_Database(database),
+	  m_Capacity(queueCapacity > 0 ? queueCapacity : 1),
+	  m_ReadBurst(readBurst > 0 ? readBurst : 1),
+	  m_ConsecutiveReads(0),
+	  m_Stopping(false)
+{
+	memset(&m_Stats, 0, sizeof(m_Stats));
+	m_Thread = std::thread(&SQLiteAsyncExecutor::workerThread, this);
+}
+
+SQLiteAsyncExecutor::~SQLiteAsyncExecutor()
+{
+	shutdown();
+}
+
+SQLiteAsyncExecutor::Stats SQLiteAsyncExecutor::stats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Stats stats = m_Stats;
+	stats.queueDepth[ReadLane] = m_Queues[ReadLane].size();
+	stats.queueDepth[WriteLane] = m_Queues[WriteLane].size();
+	return stats;
+}
+
+void SQLiteAsyncExecutor::post(Lane lane, const Task & task, const CompletionCallback & onComplete)
+{
+	enqueue(lane, wrap(task, onComplete), true);
+}
+
+bool SQLiteAsyncExecutor::tryPost(Lane lane, const Task & task, const CompletionCallback & onComplete)
+{
+	return enqueue(lane, wrap(task, onComplete), false);
+}
+
+std::future<void> SQLiteAsyncExecutor::exec(const std::string & sql)
+{
+	return submit(WriteLane, [sql](SQLiteDatabase & db) { db.exec(sql); });
+}
+
+std::future<SQLiteResultSet> SQLiteAsyncExecutor::query(const std::string & sql)
+{
+	return submit(ReadLane, [sql](SQLiteDatabase & db) -> SQLiteResultSet {
+		SQLiteResultSet result;
+		db.exec(sql, result);
+		return result;
+	});
+}
+
+std::future<void> SQLiteAsyncExecutor::transaction(const Task & protectedCode)
+{
+	return submit(WriteLane, [protectedCode](SQLiteDatabase & db) {
+		db.transaction([&protectedCode, &db]() { protectedCode(db); });
+	});
+}
+
+void SQLiteAsyncExecutor::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+	m_NotEmpty.notify_all();
+	m_NotFull.notify_all();
+
+	if (m_Thread.joinable())
+		m_Thread.join();
+}
+
+std::function<void()> SQLiteAsyncExecutor::wrap(const Task & task, const CompletionCallback & onComplete)
+{
+	SQLiteDatabase & db = m_Database;
+	return [task, onComplete, &db]() {
+		try
+		{
+			task(db);
+		}
+		catch (...)
+		{
+			if (onComplete)
+				onComplete(std::current_exception());
+			throw;
+		}
+		if (onComplete)
+			onComplete(std::exception_ptr());
+	};
+}
+
+bool SQLiteAsyncExecutor::enqueue(Lane lane, std::function<void()> && run, bool block)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (UNLIKELY(m_Stopping))
+		throw std::runtime_error("attempted to submit a task into the stopped database executor.");
+
+	if (m_Queues[ReadLane].size() + m_Queues[WriteLane].size() >= m_Capacity)
+	{
+		if (!block)
+		{
+			++m_Stats.rejectedSubmissions;
+			return false;
+		}
+
+		++m_Stats.blockedSubmissions;
+		m_NotFull.wait(lock, [this]() {
+			return m_Stopping || m_Queues[ReadLane].size() + m_Queues[WriteLane].size() < m_Capacity;
+		});
+
+		if (UNLIKELY(m_Stopping))
+			throw std::runtime_error("attempted to submit a task into the stopped database executor.");
+	}
+
+	QueuedTask task;
+	task.run = std::move(run);
+	task.enqueueTime = std::chrono::steady_clock::now();
+	m_Queues[lane].push_back(std::move(task));
+
+	++m_Stats.submitted;
+	size_t depth = m_Queues[ReadLane].size() + m_Queues[WriteLane].size();
+	if (depth > m_Stats.peakQueueDepth)
+		m_Stats.peakQueueDepth = depth;
+
+	lock.unlock();
+	m_NotEmpty.notify_one();
+
+	return true;
+}
+
+void SQLiteAsyncExecutor::workerThread()
+{
+	for (;;)
+	{
+		QueuedTask task;
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_NotEmpty.wait(lock, [this]() {
+				return m_Stopping || !m_Queues[ReadLane].empty() || !m_Queues[WriteLane].empty();
+			});
+
+			bool hasReads = !m_Queues[ReadLane].empty();
+			bool hasWrites = !m_Queues[WriteLane].empty();
+			if (!hasReads && !hasWrites)
+				return;
+
+			Lane lane = WriteLane;
+			if (hasReads && (!hasWrites || m_ConsecutiveReads < m_ReadBurst))
+				lane = ReadLane;
+			m_ConsecutiveReads = (lane == ReadLane ? m_ConsecutiveReads + 1 : 0);
+
+			task = std::move(m_Queues[lane].front());
+			m_Queues[lane].pop_front();
+
+			uint64_t waitTime = SQLiteMicrosecondsSince(task.enqueueTime);
+			m_Stats.queueWaitMicroseconds += waitTime;
+			if (waitTime > m_Stats.maxQueueWaitMicroseconds)
+				m_Stats.maxQueueWaitMicroseconds = waitTime;
+		}
+		m_NotFull.notify_one();
+
+		auto start = std::chrono::steady_clock::now();
+		bool success = true;
+		try
+		{
+			task.run();
+		}
+		catch (...)
+		{
+			success = false;
+		}
+		uint64_t executionTime = SQLiteMicrosecondsSince(start);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.executionMicroseconds += executionTime;
+		if (success)
+			++m_Stats.completed;
+		else
+			++m_Stats.failed;
+	}
+}
@@ -0,0 +1,165 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __8da66f2848bf9c7d30ffd0e50003ac57__
+#define __8da66f2848bf9c7d30ffd0e50003ac57__
+
+#include "sqlite_database.h"
+#include "sqlite_result_set.h"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <utility>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <memory>
+#include <string>
+#include <deque>
+#include <mutex>
+
+// Executes database operations on a dedicated worker thread, so that calling threads never block on disk I/O
+// or database locks. Submission queue is bounded: when it is full, `post` and `submit` block the caller and
+// `tryPost` fails. Reads are served before writes, but no more than `readBurst` reads in a row while there are
+// pending writes.
+class SQLiteAsyncExecutor
+{
+public:
+	enum Lane
+	{
+		ReadLane = 0,
+		WriteLane = 1,
+	};
+
+	enum
+	{
+		DefaultQueueCapacity = 1024,
+		DefaultReadBurst = 8,
+	};
+
+	struct Stats
+	{
+		size_t queueDepth[2];
+		size_t peakQueueDepth;
+		size_t submitted;
+		size_t completed;
+		size_t failed;
+		size_t blockedSubmissions;
+		size_t rejectedSubmissions;
+		uint64_t queueWaitMicroseconds;
+		uint64_t maxQueueWaitMicroseconds;
+		uint64_t executionMicroseconds;
+	};
+
+	typedef std::function<void(SQLiteDatabase & db)> Task;
+	typedef std::function<void(std::exception_ptr error)> CompletionCallback;
+
+	SQLiteAsyncExecutor(SQLiteDatabase & database, size_t queueCapacity = DefaultQueueCapacity,
+		size_t readBurst = DefaultReadBurst);
+	~SQLiteAsyncExecutor();
+
+	inline SQLiteDatabase & database() const noexcept { return m_Database; }
+
+	Stats stats() const;
+
+	// Enqueues the task. Completion callback is invoked on the worker thread with a null pointer on success or
+	// with the exception thrown by the task.
+	void post(Lane lane, const Task & task, const CompletionCallback & onComplete = nullptr);
+	bool tryPost(Lane lane, const Task & task, const CompletionCallback & onComplete = nullptr);
+
+	// Enqueues the callable taking `SQLiteDatabase &` and returns future for its result.
+	template <class FUNC> auto submit(Lane lane, FUNC && func)
+		-> std::future<decltype(func(std::declval<SQLiteDatabase &>()))>;
+
+	std::future<void> exec(const std::string & sql);
+	std::future<SQLiteResultSet> query(const std::string & sql);
+	std::future<void> transaction(const Task & protectedCode);
+
+	// Executes all pending tasks and stops the worker thread. Tasks could not be submitted afterwards.
+	void shutdown();
+
+private:
+	struct QueuedTask
+	{
+		std::function<void()> run;
+		std::chrono::steady_clock::time_point enqueueTime;
+	};
+
+	template <class RESULT> struct Completion
+	{
+		template <class FUNC> static void run(std::promise<RESULT> & promise, FUNC & func, SQLiteDatabase & db)
+			{ promise.set_value(func(db)); }
+	};
+
+	SQLiteDatabase & m_Database;
+	std::deque<QueuedTask> m_Queues[2];
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_NotEmpty;
+	std::condition_variable m_NotFull;
+	std::thread m_Thread;
+	size_t m_Capacity;
+	size_t m_ReadBurst;
+	size_t m_ConsecutiveReads;
+	bool m_Stopping;
+	Stats m_Stats;
+
+	std::function<void()> wrap(const Task & task, const CompletionCallback & onComplete);
+	bool enqueue(Lane lane, std::function<void()> && run, bool block);
+	void workerThread();
+
+	SQLiteAsyncExecutor(const SQLiteAsyncExecutor &) = delete;
+	SQLiteAsyncExecutor & operator=(const SQLiteAsyncExecutor &) = delete;
+};
+
+template <> struct SQLiteAsyncExecutor::Completion<void>
+{
+	template <class FUNC> static void run(std::promise<void> & promise, FUNC & func, SQLiteDatabase & db)
+		{ func(db); promise.set_value(); }
+};
+
+template <class FUNC> auto SQLiteAsyncExecutor::submit(Lane lane, FUNC && func)
+	-> std::future<decltype(func(std::declval<SQLiteDatabase &>()))>
+{
+	typedef decltype(func(std::declval<SQLiteDatabase &>())) Result;
+	typedef typename std::decay<FUNC>::type Func;
+
+	std::shared_ptr<std::promise<Result>> promise = std::make_shared<std::promise<Result>>();
+	std::future<Result> future = promise->get_future();
+
+	SQLiteDatabase & db = m_Database;
+	Func f(std::forward<FUNC>(func));
+	enqueue(lane, [promise, f, &db]() mutable {
+		try
+		{
+			Completion<Result>::run(*promise, f, db);
+		}
+		catch (...)
+		{
+			promise->set_exception(std::current_exception());
+			throw;
+		}
+	}, true);
+
+	return future;
+}
+
+#endif
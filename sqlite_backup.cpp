@@ -0,0 +1,194 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_backup.h"
+#include "sqlite_clock.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+#include <thread>
+#include <cstring>
+
+namespace
+{
+	const uint64_t BusyRetryMicroseconds = 10000;
+}
+
+/* SQLiteBackup::Options */
+
+SQLiteBackup::Options::Options() noexcept
+	: pagesPerStep(DefaultPagesPerStep),
+	  pagesPerSecond(0.0),
+	  busyTimeoutMilliseconds(5000)
+{
+}
+
+
+/* SQLiteBackup */
+
+SQLiteBackup::SQLiteBackup(SQLiteDatabase & source, SQLiteDatabase & destination, const Options & options)
+	: m_Source(source),
+	  m_Destination(destination),
+	  m_Handle(nullptr),
+	  m_Options(options),
+	  m_Busy(false),
+	  m_Done(false)
+{
+	if (UNLIKELY(options.pagesPerStep <= 0))
+		throw std::runtime_error(fmt() << "invalid number of pages per backup step (" << options.pagesPerStep << ").");
+	if (UNLIKELY(options.pagesPerSecond < 0.0))
+		throw std::runtime_error(fmt() << "invalid backup page budget (" << options.pagesPerSecond << ").");
+
+	memset(&m_Progress, 0, sizeof(m_Progress));
+
+	m_Handle = sqlite3_backup_init(m_Destination.handle(), "main", m_Source.handle(), "main");
+	if (UNLIKELY(!m_Handle))
+	{
+		throw std::runtime_error(fmt() << "unable to start backup of database '" << m_Source.fileName()
+			<< "' into '" << m_Destination.fileName() << "': " << sqlite3_errmsg(m_Destination.handle()));
+	}
+}
+
+SQLiteBackup::~SQLiteBackup()
+{
+	finish();
+}
+
+bool SQLiteBackup::step()
+{
+	if (UNLIKELY(m_Done))
+		return true;
+	if (UNLIKELY(!m_Handle))
+		throw std::runtime_error(fmt() << "backup of database '" << m_Source.fileName() << "' has been aborted.");
+
+	if (m_Progress.steps == 0 && m_Progress.busyRetries == 0)
+		m_StartTime = std::chrono::steady_clock::now();
+
+	int prevCopied = m_Progress.totalPages - m_Progress.remainingPages;
+	int err = sqlite3_backup_step(m_Handle, m_Options.pagesPerStep);
+	m_Progress.elapsedMicroseconds = SQLiteMicrosecondsSince(m_StartTime);
+
+	// Timeout is counted from the first attempt that found the database locked
+	if (err == SQLITE_BUSY || err == SQLITE_LOCKED)
+	{
+		if (!m_Busy)
+		{
+			m_Busy = true;
+			m_BusySince = std::chrono::steady_clock::now();
+		}
+
+		++m_Progress.busyRetries;
+		if (UNLIKELY(SQLiteMicrosecondsSince(m_BusySince) >= m_Options.busyTimeoutMilliseconds * 1000))
+		{
+			finish();
+			throw std::runtime_error(fmt() << "backup of database '" << m_Source.fileName()
+				<< "' has timed out waiting for a lock: " << sqlite3_errstr(err));
+		}
+		return false;
+	}
+
+	if (UNLIKELY(err != SQLITE_OK && err != SQLITE_DONE))
+	{
+		finish();
+		throw std::runtime_error(fmt() << "backup of database '" << m_Source.fileName() << "' into '"
+			<< m_Destination.fileName() << "' has failed: " << sqlite3_errmsg(m_Destination.handle()));
+	}
+
+	m_Busy = false;
+	m_Progress.remainingPages = sqlite3_backup_remaining(m_Handle);
+	m_Progress.totalPages = sqlite3_backup_pagecount(m_Handle);
+
+	// When the source is modified by another connection, SQLite starts copying from the first page again, so
+	// a step after the first one that ends within the first `pagesPerStep` pages has restarted the backup.
+	int copied = m_Progress.totalPages - m_Progress.remainingPages;
+	if (m_Progress.steps == 0)
+		m_Progress.pagesCopied += uint64_t(copied);
+	else if (UNLIKELY(copied <= m_Options.pagesPerStep))
+	{
+		++m_Progress.restarts;
+		m_Progress.pagesCopied += uint64_t(copied);
+	}
+	else if (LIKELY(copied > prevCopied))
+		m_Progress.pagesCopied += uint64_t(copied - prevCopied);
+	++m_Progress.steps;
+
+	if (err == SQLITE_DONE)
+	{
+		err = finish();
+		if (UNLIKELY(err != SQLITE_OK))
+		{
+			throw std::runtime_error(fmt() << "unable to finish backup of database '" << m_Source.fileName()
+				<< "' into '" << m_Destination.fileName() << "': " << sqlite3_errmsg(m_Destination.handle()));
+		}
+		m_Done = true;
+	}
+
+	return m_Done;
+}
+
+bool SQLiteBackup::run(const ProgressCallback & onProgress)
+{
+	auto runStart = std::chrono::steady_clock::now();
+	uint64_t pagesAtStart = m_Progress.pagesCopied;
+
+	while (!step())
+	{
+		if (onProgress && !onProgress(m_Progress))
+		{
+			finish();
+			return false;
+		}
+
+		if (m_Busy)
+			std::this_thread::sleep_for(std::chrono::microseconds(BusyRetryMicroseconds));
+		else if (m_Options.pagesPerSecond > 0.0)
+		{
+			double budget = double(m_Progress.pagesCopied - pagesAtStart) / m_Options.pagesPerSecond * 1000000.0;
+			uint64_t elapsed = SQLiteMicrosecondsSince(runStart);
+			if (budget > double(elapsed))
+				std::this_thread::sleep_for(std::chrono::microseconds(uint64_t(budget) - elapsed));
+		}
+	}
+
+	if (onProgress)
+		onProgress(m_Progress);
+
+	return true;
+}
+
+bool SQLiteBackup::copy(SQLiteDatabase & source, const std::string & destinationFile, const Options & options,
+	const ProgressCallback & onProgress)
+{
+	SQLiteDatabase destination(destinationFile);
+	SQLiteBackup backup(source, destination, options);
+	return backup.run(onProgress);
+}
+
+int SQLiteBackup::finish() noexcept
+{
+	if (!m_Handle)
+		return SQLITE_OK;
+
+	int err = sqlite3_backup_finish(m_Handle);
+	m_Handle = nullptr;
+	return err;
+}
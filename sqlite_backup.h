@@ -0,0 +1,106 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __6ba920fc56d4d86224c6ef62fdbde22f__
+#define __6ba920fc56d4d86224c6ef62fdbde22f__
+
+#include "sqlite_database.h"
+#include <functional>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+// Online copy of a live database. Pages are copied in small steps with pauses between them, so that the source
+// stays available to other connections during the backup. If the source is modified by another connection,
+// SQLite restarts the copy from the beginning; modifications made through the source connection itself are
+// applied to the copy directly.
+class SQLiteBackup
+{
+public:
+	enum { DefaultPagesPerStep = 64 };
+
+	struct Options
+	{
+		int pagesPerStep;
+		double pagesPerSecond;              // Zero means no limit
+		uint64_t busyTimeoutMilliseconds;   // How long to wait for locks held by other connections
+
+		Options() noexcept;
+	};
+
+	struct Progress
+	{
+		int remainingPages;
+		int totalPages;
+		uint64_t pagesCopied;       // Including pages copied again after restarts
+		size_t steps;
+		size_t restarts;
+		size_t busyRetries;
+		uint64_t elapsedMicroseconds;
+
+		inline double fraction() const noexcept
+			{ return totalPages > 0 ? double(totalPages - remainingPages) / double(totalPages) : 0.0; }
+	};
+
+	// Return false to abort the backup.
+	typedef std::function<bool(const Progress & progress)> ProgressCallback;
+
+	// Destination may be a file or an in-memory database. Its previous contents are replaced; it should not be
+	// used by anybody else until the backup is finished.
+	SQLiteBackup(SQLiteDatabase & source, SQLiteDatabase & destination, const Options & options = Options());
+	~SQLiteBackup();
+
+	inline const Progress & progress() const noexcept { return m_Progress; }
+	inline bool isDone() const noexcept { return m_Done; }
+	inline bool isBusy() const noexcept { return m_Busy; }
+
+	// Copies next portion of pages without throttling. Returns true when the backup is complete. If the source
+	// or the destination is locked, returns false at once and `isBusy` returns true: the caller should retry
+	// later. Throws if the locks are held for longer than `busyTimeoutMilliseconds`.
+	bool step();
+
+	// Copies all pages, pausing between steps to stay within the page budget and to wait for locks. Returns
+	// false if the backup was aborted by the callback.
+	bool run(const ProgressCallback & onProgress = ProgressCallback());
+
+	// Copies the whole `source` into the database file `destinationFile`.
+	static bool copy(SQLiteDatabase & source, const std::string & destinationFile,
+		const Options & options = Options(), const ProgressCallback & onProgress = ProgressCallback());
+
+private:
+	SQLiteDatabase & m_Source;
+	SQLiteDatabase & m_Destination;
+	sqlite3_backup * m_Handle;
+	Options m_Options;
+	Progress m_Progress;
+	std::chrono::steady_clock::time_point m_StartTime;
+	std::chrono::steady_clock::time_point m_BusySince;
+	bool m_Busy;
+	bool m_Done;
+
+	int finish() noexcept;
+
+	SQLiteBackup(const SQLiteBackup &) = delete;
+	SQLiteBackup & operator=(const SQLiteBackup &) = delete;
+};
+
+#endif
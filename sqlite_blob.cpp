@@ -0,0 +1,210 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_blob.h"
+#include "sqlite_database.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+#include <vector>
+
+SQLiteBlob::SQLiteBlob(SQLiteDatabase & database, const std::string & table, const std::string & column,
+		sqlite3_int64 rowid, Mode mode, const std::string & schema)
+	: m_Database(database),
+	  m_Handle(nullptr),
+	  m_Table(table),
+	  m_Column(column),
+	  m_RowId(rowid),
+	  m_Size(0),
+	  m_Position(0),
+	  m_Valid(true)
+{
+	SQLiteDatabase::Locker locker(m_Database);
+
+	int err = sqlite3_blob_open(m_Database.handle(), schema.c_str(), table.c_str(), column.c_str(), rowid,
+		mode == ReadWrite ? 1 : 0, &m_Handle);
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		std::string message = sqlite3_errmsg(m_Database.handle());
+		sqlite3_blob_close(m_Handle);
+		throw std::runtime_error(fmt() << "unable to open blob " << table << '.' << column << " in row " << rowid
+			<< ": " << message);
+	}
+
+	m_Size = size_t(sqlite3_blob_bytes(m_Handle));
+}
+
+SQLiteBlob::~SQLiteBlob()
+{
+	SQLiteDatabase::Locker locker(m_Database);
+	sqlite3_blob_close(m_Handle);
+}
+
+void SQLiteBlob::seek(size_t position)
+{
+	checkValid();
+	if (UNLIKELY(position > m_Size))
+	{
+		throw std::runtime_error(fmt() << "position " << position << " is beyond the end of blob "
+			<< m_Table << '.' << m_Column << " in row " << m_RowId << " (" << m_Size << " bytes).");
+	}
+	m_Position = position;
+}
+
+size_t SQLiteBlob::read(void * buffer, size_t size)
+{
+	checkValid();
+
+	size_t remaining = m_Size - m_Position;
+	if (size > remaining)
+		size = remaining;
+	if (size == 0)
+		return 0;
+
+	readAt(m_Position, buffer, size);
+	m_Position += size;
+
+	return size;
+}
+
+void SQLiteBlob::write(const void * data, size_t size)
+{
+	writeAt(m_Position, data, size);
+	m_Position += size;
+}
+
+void SQLiteBlob::readAt(size_t offset, void * buffer, size_t size)
+{
+	checkValid();
+	checkRange(offset, size);
+	if (size == 0)
+		return;
+
+	SQLiteDatabase::Locker locker(m_Database);
+	checkError(sqlite3_blob_read(m_Handle, buffer, int(size), int(offset)), "read");
+}
+
+void SQLiteBlob::writeAt(size_t offset, const void * data, size_t size)
+{
+	checkValid();
+	checkRange(offset, size);
+	if (size == 0)
+		return;
+
+	SQLiteDatabase::Locker locker(m_Database);
+	checkError(sqlite3_blob_write(m_Handle, data, int(size), int(offset)), "write");
+}
+
+void SQLiteBlob::reopen(sqlite3_int64 rowid)
+{
+	checkValid();
+
+	SQLiteDatabase::Locker locker(m_Database);
+
+	m_RowId = rowid;
+	m_Position = 0;
+
+	int err = sqlite3_blob_reopen(m_Handle, rowid);
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		// SQLite aborts the handle, so it can not be reopened again
+		m_Size = 0;
+		m_Valid = false;
+		checkError(err, "open");
+	}
+
+	m_Size = size_t(sqlite3_blob_bytes(m_Handle));
+}
+
+void SQLiteBlob::readChunks(const ChunkCallback & onChunk, size_t chunkSize)
+{
+	checkValid();
+
+	if (chunkSize == 0)
+		chunkSize = DefaultChunkSize;
+
+	size_t remaining = m_Size - m_Position;
+	std::vector<char> buffer(remaining < chunkSize ? remaining : chunkSize);
+
+	while (m_Position < m_Size)
+	{
+		size_t size = read(buffer.data(), buffer.size());
+		onChunk(buffer.data(), size);
+	}
+}
+
+size_t SQLiteBlob::writeChunks(const SourceCallback & source, size_t chunkSize)
+{
+	checkValid();
+
+	if (chunkSize == 0)
+		chunkSize = DefaultChunkSize;
+
+	size_t remaining = m_Size - m_Position;
+	std::vector<char> buffer(remaining < chunkSize ? remaining : chunkSize);
+
+	size_t total = 0;
+	while (m_Position < m_Size)
+	{
+		size_t size = m_Size - m_Position;
+		if (size > buffer.size())
+			size = buffer.size();
+
+		size = source(buffer.data(), size);
+		if (size == 0)
+			break;
+
+		write(buffer.data(), size);
+		total += size;
+	}
+
+	return total;
+}
+
+void SQLiteBlob::checkValid() const
+{
+	if (UNLIKELY(!m_Valid))
+	{
+		throw std::runtime_error(fmt() << "blob handle for " << m_Table << '.' << m_Column
+			<< " is unusable after a failed reopen for row " << m_RowId << '.');
+	}
+}
+
+void SQLiteBlob::checkRange(size_t offset, size_t size) const
+{
+	if (UNLIKELY(offset > m_Size || size > m_Size - offset))
+	{
+		throw std::runtime_error(fmt() << "range " << offset << '+' << size << " is outside of blob "
+			<< m_Table << '.' << m_Column << " in row " << m_RowId << " (" << m_Size << " bytes).");
+	}
+}
+
+void SQLiteBlob::checkError(int err, const char * operation) const
+{
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		const char * message = (err == SQLITE_ABORT ?
+			"blob has expired (row was modified or deleted)" : sqlite3_errmsg(m_Database.handle()));
+		throw std::runtime_error(fmt() << "unable to " << operation << " blob " << m_Table << '.' << m_Column
+			<< " in row " << m_RowId << ": " << message);
+	}
+}
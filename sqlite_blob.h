@@ -0,0 +1,115 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __2dcd571765b306eeda3ca56f8538e850__
+#define __2dcd571765b306eeda3ca56f8538e850__
+
+#include <yip-imports/sqlite3.h>
+#include <functional>
+#include <cstdint>
+#include <string>
+
+class SQLiteDatabase;
+
+// Incremental I/O on a single blob (sqlite3_blob_*). Only the requested range is read or written, so memory
+// used for a large blob is bounded by the size of the chunk. Size of the blob can not be changed through the
+// handle: to store a large value, insert a zeroblob of the final size (SQLiteStatement::bindZeroBlob) and then
+// fill it in chunks:
+//
+//   SQLiteStatement insert(db, "INSERT INTO media (data) VALUES (?)");
+//   insert.bindZeroBlob(1, fileSize);
+//   insert.exec();
+//   SQLiteBlob blob(db, "media", "data", db.lastInsertId(), SQLiteBlob::ReadWrite);
+//   blob.writeChunks([file](void * buffer, size_t size) { return fread(buffer, 1, size, file); });
+//
+// The handle expires when its row is modified or deleted other than through the handle itself; all subsequent
+// operations, including `reopen`, then throw and a new handle has to be opened. The destructor locks the
+// database, so the blob should be destroyed before its database.
+class SQLiteBlob
+{
+public:
+	enum Mode
+	{
+		ReadOnly = 0,
+		ReadWrite,
+	};
+
+	enum { DefaultChunkSize = 256 * 1024 };
+
+	typedef std::function<void(const void * data, size_t size)> ChunkCallback;
+
+	// Fills `buffer` with at most `size` bytes and returns the number of bytes stored; zero means no more data.
+	typedef std::function<size_t(void * buffer, size_t size)> SourceCallback;
+
+	SQLiteBlob(SQLiteDatabase & database, const std::string & table, const std::string & column,
+		sqlite3_int64 rowid, Mode mode = ReadOnly, const std::string & schema = "main");
+	~SQLiteBlob();
+
+	inline sqlite3_blob * handle() const noexcept { return m_Handle; }
+	inline sqlite3_int64 rowid() const noexcept { return m_RowId; }
+	inline size_t size() const noexcept { return m_Size; }
+	inline size_t position() const noexcept { return m_Position; }
+
+	void seek(size_t position);
+
+	// Reads at most `size` bytes from the current position; returns number of bytes read (zero at the end).
+	size_t read(void * buffer, size_t size);
+
+	// Writes at the current position. Throws if the data does not fit into the blob.
+	void write(const void * data, size_t size);
+
+	// Random access; the range should be within the blob. These do not move the current position.
+	void readAt(size_t offset, void * buffer, size_t size);
+	void writeAt(size_t offset, const void * data, size_t size);
+
+	// Moves the handle to the same column of another row. This is much cheaper than opening a new handle,
+	// so use it to walk over many rows. Resets the current position. If the row does not exist or does not
+	// contain a blob or text, the handle becomes unusable and all further operations throw.
+	void reopen(sqlite3_int64 rowid);
+
+	// Reads the rest of the blob from the current position, passing it to `onChunk` in portions of at most
+	// `chunkSize` bytes. The database is not locked while `onChunk` runs.
+	void readChunks(const ChunkCallback & onChunk, size_t chunkSize = DefaultChunkSize);
+
+	// Writes data produced by `source` starting at the current position until `source` returns zero or the
+	// blob is full. Returns number of bytes written.
+	size_t writeChunks(const SourceCallback & source, size_t chunkSize = DefaultChunkSize);
+
+private:
+	SQLiteDatabase & m_Database;
+	sqlite3_blob * m_Handle;
+	std::string m_Table;
+	std::string m_Column;
+	sqlite3_int64 m_RowId;
+	size_t m_Size;
+	size_t m_Position;
+	bool m_Valid;
+
+	void checkValid() const;
+	void checkRange(size_t offset, size_t size) const;
+	void checkError(int err, const char * operation) const;
+
+	SQLiteBlob(const SQLiteBlob &) = delete;
+	SQLiteBlob & operator=(const SQLiteBlob &) = delete;
+};
+
+#endif
@@ -0,0 +1,42 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __6c64524e9471ccc85621afe1f080d25a__
+#define __6c64524e9471ccc85621afe1f080d25a__
+
+#include <chrono>
+#include <cstdint>
+
+// Clock used for all elapsed time statistics of the library. Internal header, not a part of the public API.
+typedef std::chrono::steady_clock SQLiteClock;
+
+inline uint64_t SQLiteMicrosecondsBetween(SQLiteClock::time_point start, SQLiteClock::time_point end) noexcept
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+}
+
+inline uint64_t SQLiteMicrosecondsSince(SQLiteClock::time_point start) noexcept
+{
+	return SQLiteMicrosecondsBetween(start, SQLiteClock::now());
+}
+
+#endif
@@ -0,0 +1,195 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_columnar_batch.h"
+#include "sqlite_statement.h"
+#include "sqlite_database.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+
+SQLiteColumnarBatch::SQLiteColumnarBatch()
+	: m_Statement(nullptr),
+	  m_NumRows(0),
+	  m_Done(false)
+{
+}
+
+SQLiteColumnarBatch::~SQLiteColumnarBatch()
+{
+}
+
+bool SQLiteColumnarBatch::fetch(const SQLiteStatement & statement, size_t maxRows)
+{
+	sqlite3_stmt * stmt = statement.handle();
+	SQLiteDatabase::Locker locker(stmt);
+
+	if (m_Statement != stmt)
+		init(stmt);
+
+	clear();
+	if (m_Done)
+	{
+		m_Done = false;
+		return false;
+	}
+
+	try
+	{
+		while (m_NumRows < maxRows)
+		{
+			int err = sqlite3_step(stmt);
+			if (err == SQLITE_DONE)
+			{
+				sqlite3_reset(stmt);
+				m_Done = (m_NumRows > 0);
+				break;
+			}
+			else if (UNLIKELY(err != SQLITE_ROW))
+			{
+				sqlite3 * db = sqlite3_db_handle(stmt);
+				throw std::runtime_error(fmt()
+					<< "unable to execute statement '" << sqlite3_sql(stmt) << "': " << sqlite3_errmsg(db));
+			}
+
+			append(stmt);
+		}
+	}
+	catch (...)
+	{
+		sqlite3_reset(stmt);
+		throw;
+	}
+
+	return m_NumRows > 0;
+}
+
+void SQLiteColumnarBatch::reset() noexcept
+{
+	m_Columns.clear();
+	m_Statement = nullptr;
+	m_NumRows = 0;
+	m_Done = false;
+}
+
+void SQLiteColumnarBatch::init(sqlite3_stmt * stmt)
+{
+	m_Statement = stmt;
+	m_Done = false;
+
+	int numColumns = sqlite3_column_count(stmt);
+	m_Columns.clear();
+	m_Columns.resize(size_t(numColumns));
+	for (int i = 0; i < numColumns; i++)
+	{
+		const char * name = sqlite3_column_name(stmt, i);
+		m_Columns[size_t(i)].name = (name ? name : "");
+		m_Columns[size_t(i)].type = SQLiteCursor::ColumnNull;
+	}
+}
+
+void SQLiteColumnarBatch::clear() noexcept
+{
+	for (Column & column : m_Columns)
+	{
+		column.ints.clear();
+		column.doubles.clear();
+		column.offsets.clear();
+		column.bytes.clear();
+		column.nulls.clear();
+	}
+	m_NumRows = 0;
+}
+
+void SQLiteColumnarBatch::append(sqlite3_stmt * stmt)
+{
+	size_t row = m_NumRows;
+	int index = 0;
+
+	for (Column & column : m_Columns)
+	{
+		int type = sqlite3_column_type(stmt, index);
+
+		if (column.type == SQLiteCursor::ColumnNull && type != SQLITE_NULL)
+		{
+			// Type is detected on the first non-NULL value: convert placeholders for previous NULL values.
+			column.type = SQLiteCursor::ColumnType(type);
+			switch (type)
+			{
+			case SQLITE_INTEGER: column.ints.assign(row, 0); break;
+			case SQLITE_FLOAT: column.doubles.assign(row, 0.0); break;
+			default: column.offsets.assign(row + 1, 0); break;
+			}
+		}
+		else if (column.type == SQLiteCursor::ColumnInt && type == SQLITE_FLOAT)
+		{
+			column.type = SQLiteCursor::ColumnFloat;
+			column.doubles.reserve(column.ints.size() + 1);
+			for (sqlite3_int64 value : column.ints)
+				column.doubles.push_back(static_cast<double>(value));
+			column.ints.clear();
+		}
+
+		if ((row & 7) == 0)
+			column.nulls.push_back(0);
+		if (type == SQLITE_NULL)
+			column.nulls[row >> 3] |= uint8_t(1 << (row & 7));
+
+		switch (column.type)
+		{
+		case SQLiteCursor::ColumnNull:
+			break;
+
+		case SQLiteCursor::ColumnInt:
+			column.ints.push_back(type == SQLITE_NULL ? 0 : sqlite3_column_int64(stmt, index));
+			break;
+
+		case SQLiteCursor::ColumnFloat:
+			column.doubles.push_back(type == SQLITE_NULL ? 0.0 : sqlite3_column_double(stmt, index));
+			break;
+
+		case SQLiteCursor::ColumnText:
+		case SQLiteCursor::ColumnBlob: {
+			if (column.offsets.empty())
+				column.offsets.push_back(0);
+			if (type != SQLITE_NULL)
+			{
+				const void * data = (column.type == SQLiteCursor::ColumnText ?
+					static_cast<const void *>(sqlite3_column_text(stmt, index)) :
+					sqlite3_column_blob(stmt, index));
+				size_t size = static_cast<size_t>(sqlite3_column_bytes(stmt, index));
+				if (size > 0)
+				{
+					const char * p = static_cast<const char *>(data);
+					column.bytes.insert(column.bytes.end(), p, p + size);
+				}
+			}
+			column.offsets.push_back(column.bytes.size());
+			break;
+			}
+		}
+
+		++index;
+	}
+
+	++m_NumRows;
+}
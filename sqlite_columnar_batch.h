@@ -0,0 +1,89 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __ed0459ddf9ee2be78ea67c343416c461__
+#define __ed0459ddf9ee2be78ea67c343416c461__
+
+#include "sqlite_cursor.h"
+#include <yip-imports/sqlite3.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+class SQLiteStatement;
+
+// Struct-of-arrays buffer for query results. Each column stores its values in a single typed array:
+// integers in `ints`, floats in `doubles`, text and blobs in `bytes` with `offsets` (numRows + 1 entries).
+// NULL values are marked in `nulls` (one bit per row, set for NULL) and hold zero / empty value in the array.
+//
+// Column type is fixed by the first non-NULL value fetched for the column. Integer columns are promoted to
+// float when a float value is encountered (already fetched values of the current batch are converted).
+// Any other mismatching value is converted to the column type using SQLite's own conversion rules.
+class SQLiteColumnarBatch
+{
+public:
+	struct Column
+	{
+		std::string name;
+		SQLiteCursor::ColumnType type;
+		std::vector<sqlite3_int64> ints;
+		std::vector<double> doubles;
+		std::vector<size_t> offsets;
+		std::vector<char> bytes;
+		std::vector<uint8_t> nulls;
+
+		inline bool isNull(size_t row) const noexcept { return (nulls[row >> 3] & (1 << (row & 7))) != 0; }
+
+		inline const char * data(size_t row) const noexcept { return bytes.data() + offsets[row]; }
+		inline size_t size(size_t row) const noexcept { return offsets[row + 1] - offsets[row]; }
+	};
+
+	SQLiteColumnarBatch();
+	~SQLiteColumnarBatch();
+
+	inline size_t numRows() const noexcept { return m_NumRows; }
+	inline size_t numColumns() const noexcept { return m_Columns.size(); }
+	inline const Column & column(size_t index) const noexcept { return m_Columns[index]; }
+
+	// Fetches up to `maxRows` next rows of the statement, replacing previous contents of the batch.
+	// Returns `false` if there are no more rows; in this case statement is reset and the next call to this
+	// method will execute the statement again.
+	bool fetch(const SQLiteStatement & stmt, size_t maxRows);
+
+	// Forgets column types detected so far.
+	void reset() noexcept;
+
+private:
+	std::vector<Column> m_Columns;
+	sqlite3_stmt * m_Statement;
+	size_t m_NumRows;
+	bool m_Done;
+
+	void init(sqlite3_stmt * stmt);
+	void clear() noexcept;
+	void append(sqlite3_stmt * stmt);
+
+	SQLiteColumnarBatch(const SQLiteColumnarBatch &) = delete;
+	SQLiteColumnarBatch & operator=(const SQLiteColumnarBatch &) = delete;
+};
+
+#endif
@@ -0,0 +1,280 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_connection_pool.h"
+#include "sqlite_clock.h"
+#include "sqlite_cursor.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+#include <chrono>
+#include <cstring>
+
+/* SQLiteConnectionPool::Reader */
+
+SQLiteConnectionPool::Reader::Reader(SQLiteConnectionPool & pool)
+	: m_Pool(pool),
+	  m_Database(pool.checkoutReader())
+{
+}
+
+SQLiteConnectionPool::Reader::~Reader() noexcept
+{
+	m_Pool.checkinReader(m_Database);
+}
+
+
+/* SQLiteConnectionPool::Writer */
+
+SQLiteConnectionPool::Writer::Writer(SQLiteConnectionPool & pool)
+	: m_Pool(pool)
+{
+	m_Pool.lockWriter();
+}
+
+SQLiteConnectionPool::Writer::~Writer() noexcept
+{
+	m_Pool.unlockWriter();
+}
+
+
+/* SQLiteConnectionPool */
+
+SQLiteConnectionPool::SQLiteConnectionPool(const char * file, size_t numReaders,
+		const SQLiteOpenOptions & options)
+	: m_File(file),
+	  m_WriterThread(std::thread::id()),
+	  m_WriterDepth(0)
+{
+	open(numReaders, options);
+}
+
+SQLiteConnectionPool::SQLiteConnectionPool(const std::string & file, size_t numReaders,
+		const SQLiteOpenOptions & options)
+	: m_File(file),
+	  m_WriterThread(std::thread::id()),
+	  m_WriterDepth(0)
+{
+	open(numReaders, options);
+}
+
+SQLiteConnectionPool::~SQLiteConnectionPool()
+{
+}
+
+SQLiteConnectionPool::Stats SQLiteConnectionPool::stats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void SQLiteConnectionPool::resetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Stats.peakReadersInUse = m_Stats.readersInUse;
+	m_Stats.readerCheckouts = 0;
+	m_Stats.readerWaits = 0;
+	m_Stats.readerWaitMicroseconds = 0;
+	m_Stats.writerCheckouts = 0;
+	m_Stats.writerWaits = 0;
+	m_Stats.writerWaitMicroseconds = 0;
+}
+
+void SQLiteConnectionPool::transaction(const std::function<void()> & protectedCode,
+	SQLiteDatabase::TransactionKind kind)
+{
+	Writer writer(*this);
+	writer->transaction(protectedCode, kind);
+}
+
+void SQLiteConnectionPool::exec(const char * sql)
+{
+	Writer writer(*this);
+	writer->exec(sql);
+}
+
+void SQLiteConnectionPool::exec(const std::string & sql)
+{
+	exec(sql.c_str());
+}
+
+void SQLiteConnectionPool::exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow)
+{
+	if (ownsWriter())
+	{
+		Writer writer(*this);
+		writer->exec(sql, onRow);
+		return;
+	}
+
+	Reader reader(*this);
+	reader->exec(sql, onRow);
+}
+
+void SQLiteConnectionPool::exec(const std::string & sql,
+	const std::function<void(const SQLiteCursor & cursor)> & onRow)
+{
+	exec(sql.c_str(), onRow);
+}
+
+void SQLiteConnectionPool::exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow,
+	size_t limit)
+{
+	if (ownsWriter())
+	{
+		Writer writer(*this);
+		writer->exec(sql, onRow, limit);
+		return;
+	}
+
+	Reader reader(*this);
+	reader->exec(sql, onRow, limit);
+}
+
+void SQLiteConnectionPool::exec(const std::string & sql,
+	const std::function<void(const SQLiteCursor & cursor)> & onRow, size_t limit)
+{
+	exec(sql.c_str(), onRow, limit);
+}
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+void SQLiteConnectionPool::withSnapshot(const std::function<void(const SQLiteSnapshot & snapshot)> & report)
+{
+	if (UNLIKELY(m_Readers.size() < 2))
+	{
+		throw std::runtime_error(fmt()
+			<< "connection pool for '" << m_File << "' should have at least two readers to use snapshots.");
+	}
+
+	Reader reader(*this);
+	reader->transaction([&reader, &report]() {
+		SQLiteSnapshot snapshot(reader.database());
+		if (LIKELY(report))
+			report(snapshot);
+	}, SQLiteDatabase::DeferredTransaction);
+}
+
+void SQLiteConnectionPool::read(const SQLiteSnapshot & snapshot,
+	const std::function<void(SQLiteDatabase & db)> & code)
+{
+	Reader reader(*this);
+	snapshot.read(reader.database(), [&reader, &code]() {
+		if (LIKELY(code))
+			code(reader.database());
+	});
+}
+#endif
+
+void SQLiteConnectionPool::open(size_t numReaders, const SQLiteOpenOptions & options)
+{
+	if (UNLIKELY(numReaders == 0))
+		throw std::runtime_error(fmt() << "connection pool for '" << m_File << "' should have at least one reader.");
+
+	// Readers could not open the database while the writer holds an exclusive lock
+	SQLiteOpenOptions walOptions = options;
+	walOptions.journalMode = SQLiteOpenOptions::JournalWAL;
+	walOptions.lockingMode = SQLiteOpenOptions::LockingNormal;
+
+	m_Writer.reset(new SQLiteDatabase(m_File, walOptions));
+
+	m_Readers.reserve(numReaders);
+	m_FreeReaders.reserve(numReaders);
+	for (size_t i = 0; i < numReaders; i++)
+	{
+		m_Readers.emplace_back(new SQLiteDatabase(m_File, walOptions));
+		m_Readers.back()->exec("PRAGMA query_only = 1");
+		m_FreeReaders.push_back(m_Readers.back().get());
+	}
+
+	memset(&m_Stats, 0, sizeof(m_Stats));
+	m_Stats.numReaders = numReaders;
+}
+
+SQLiteDatabase * SQLiteConnectionPool::checkoutReader()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (UNLIKELY(m_FreeReaders.empty()))
+	{
+		auto start = std::chrono::steady_clock::now();
+		m_ReaderAvailable.wait(lock, [this]() { return !m_FreeReaders.empty(); });
+		++m_Stats.readerWaits;
+		m_Stats.readerWaitMicroseconds += SQLiteMicrosecondsSince(start);
+	}
+
+	SQLiteDatabase * db = m_FreeReaders.back();
+	m_FreeReaders.pop_back();
+
+	++m_Stats.readerCheckouts;
+	if (++m_Stats.readersInUse > m_Stats.peakReadersInUse)
+		m_Stats.peakReadersInUse = m_Stats.readersInUse;
+
+	return db;
+}
+
+void SQLiteConnectionPool::checkinReader(SQLiteDatabase * db) noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_FreeReaders.push_back(db);
+		--m_Stats.readersInUse;
+	}
+	m_ReaderAvailable.notify_one();
+}
+
+void SQLiteConnectionPool::lockWriter()
+{
+	bool waited = false;
+	uint64_t waitTime = 0;
+
+	if (UNLIKELY(!m_WriterMutex.try_lock()))
+	{
+		auto start = std::chrono::steady_clock::now();
+		m_WriterMutex.lock();
+		waited = true;
+		waitTime = SQLiteMicrosecondsSince(start);
+	}
+
+	if (m_WriterDepth++ == 0)
+		m_WriterThread = std::this_thread::get_id();
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	++m_Stats.writerCheckouts;
+	if (waited)
+	{
+		++m_Stats.writerWaits;
+		m_Stats.writerWaitMicroseconds += waitTime;
+	}
+}
+
+void SQLiteConnectionPool::unlockWriter() noexcept
+{
+	if (--m_WriterDepth == 0)
+		m_WriterThread = std::thread::id();
+	m_WriterMutex.unlock();
+}
+
+// Only the owner stores its id, so other threads never see their own id there
+bool SQLiteConnectionPool::ownsWriter() const noexcept
+{
+	return m_WriterThread.load() == std::this_thread::get_id();
+}
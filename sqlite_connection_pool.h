@@ -0,0 +1,154 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __f4a91c07d2be5a38e6c1b7d09e5a6c42__
+#define __f4a91c07d2be5a38e6c1b7d09e5a6c42__
+
+#include "sqlite_database.h"
+#include "sqlite_snapshot.h"
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+
+class SQLiteCursor;
+
+// Pool of connections to a single database file in WAL mode: one writer connection and a number of
+// read-only reader connections, so that long reads do not block each other or the writer.
+class SQLiteConnectionPool
+{
+public:
+	struct Stats
+	{
+		size_t numReaders;
+		size_t readersInUse;
+		size_t peakReadersInUse;
+		size_t readerCheckouts;
+		size_t readerWaits;
+		uint64_t readerWaitMicroseconds;
+		size_t writerCheckouts;
+		size_t writerWaits;
+		uint64_t writerWaitMicroseconds;
+	};
+
+	// Checks out a free reader connection for the lifetime of the object.
+	class Reader
+	{
+	public:
+		Reader(SQLiteConnectionPool & pool);
+		~Reader() noexcept;
+
+		inline SQLiteDatabase & database() const noexcept { return *m_Database; }
+		inline SQLiteDatabase * operator->() const noexcept { return m_Database; }
+
+	private:
+		SQLiteConnectionPool & m_Pool;
+		SQLiteDatabase * m_Database;
+
+		Reader(const Reader &) = delete;
+		Reader & operator=(const Reader &) = delete;
+	};
+
+	// Gains exclusive access to the writer connection for the lifetime of the object.
+	class Writer
+	{
+	public:
+		Writer(SQLiteConnectionPool & pool);
+		~Writer() noexcept;
+
+		inline SQLiteDatabase & database() const noexcept { return *m_Pool.m_Writer; }
+		inline SQLiteDatabase * operator->() const noexcept { return m_Pool.m_Writer.get(); }
+
+	private:
+		SQLiteConnectionPool & m_Pool;
+
+		Writer(const Writer &) = delete;
+		Writer & operator=(const Writer &) = delete;
+	};
+
+	// Journal mode in `options` is always overridden with WAL and locking mode with NORMAL.
+	SQLiteConnectionPool(const char * file, size_t numReaders, const SQLiteOpenOptions & options = SQLiteOpenOptions());
+	SQLiteConnectionPool(const std::string & file, size_t numReaders,
+		const SQLiteOpenOptions & options = SQLiteOpenOptions());
+	~SQLiteConnectionPool();
+
+	inline const std::string & fileName() const { return m_File; }
+	inline size_t numReaders() const { return m_Readers.size(); }
+
+	Stats stats() const;
+	void resetStats();
+
+	// Transactions and statements without a row callback are executed on the writer connection.
+	void transaction(const std::function<void()> & protectedCode,
+		SQLiteDatabase::TransactionKind kind = SQLiteDatabase::ImmediateTransaction);
+	void exec(const char * sql);
+	void exec(const std::string & sql);
+
+	// Queries with a row callback are executed on a reader connection. If the calling thread holds the writer
+	// (e.g. inside `transaction`), they are executed on the writer, so they see its uncommitted changes. Use
+	// `Writer` to run statements that both modify the database and return rows.
+	void exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow);
+	void exec(const std::string & sql, const std::function<void(const SQLiteCursor & cursor)> & onRow);
+	void exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow, size_t limit);
+	void exec(const std::string & sql, const std::function<void(const SQLiteCursor & cursor)> & onRow, size_t limit);
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+	// Captures a snapshot on a reader connection and passes it to `report`. The reader keeps its read
+	// transaction open until `report` returns, so checkpoints cannot invalidate the snapshot meanwhile.
+	// Requires at least two readers.
+	void withSnapshot(const std::function<void(const SQLiteSnapshot & snapshot)> & report);
+
+	// Runs `code` on a free reader connection inside a read transaction opened at `snapshot`. May be called
+	// from several threads at once to execute queries of the same report in parallel.
+	void read(const SQLiteSnapshot & snapshot, const std::function<void(SQLiteDatabase & db)> & code);
+#endif
+
+private:
+	std::string m_File;
+	std::unique_ptr<SQLiteDatabase> m_Writer;
+	std::vector<std::unique_ptr<SQLiteDatabase>> m_Readers;
+	std::vector<SQLiteDatabase *> m_FreeReaders;
+	mutable std::mutex m_Mutex;
+	std::recursive_mutex m_WriterMutex;
+	std::atomic<std::thread::id> m_WriterThread;
+	size_t m_WriterDepth;
+	std::condition_variable m_ReaderAvailable;
+	Stats m_Stats;
+
+	void open(size_t numReaders, const SQLiteOpenOptions & options);
+
+	SQLiteDatabase * checkoutReader();
+	void checkinReader(SQLiteDatabase * db) noexcept;
+
+	void lockWriter();
+	void unlockWriter() noexcept;
+	bool ownsWriter() const noexcept;
+
+	SQLiteConnectionPool(const SQLiteConnectionPool &) = delete;
+	SQLiteConnectionPool & operator=(const SQLiteConnectionPool &) = delete;
+};
+
+#endif
@@ -23,11 +23,23 @@
 #ifndef __67d9d9fc4276e6645f36c8875a0eca32__
 #define __67d9d9fc4276e6645f36c8875a0eca32__
 
+#include "sqlite_traits.h"
 #include <yip-imports/sqlite3.h>
 #include <string>
+#include <tuple>
+
+#if __cplusplus >= 201703L
+ #include <string_view>
+#endif
 
 class SQLiteStatement;
 
+struct SQLiteBlobView
+{
+	const void * data;
+	size_t size;
+};
+
 class SQLiteCursor
 {
 public:
@@ -56,6 +68,23 @@ public:
 	inline const char * toText(int index) const noexcept
 		{ return reinterpret_cast<const char *>(sqlite3_column_text(m_Cursor, index)); }
 
+	// Views are valid until the next step or reset of the statement.
+	inline SQLiteBlobView toBlobView(int index) const noexcept
+	{
+		SQLiteBlobView view;
+		view.data = sqlite3_column_blob(m_Cursor, index);
+		view.size = static_cast<size_t>(sqlite3_column_bytes(m_Cursor, index));
+		return view;
+	}
+
+#if __cplusplus >= 201703L
+	inline std::string_view toStringView(int index) const noexcept
+	{
+		const char * text = reinterpret_cast<const char *>(sqlite3_column_text(m_Cursor, index));
+		return std::string_view(text, static_cast<size_t>(sqlite3_column_bytes(m_Cursor, index)));
+	}
+#endif
+
 	inline std::string toString(int index) const
 	{
 		return std::string(
@@ -64,6 +93,13 @@ public:
 		);
 	}
 
+	// Returns value of the column using the SQLiteTraits specialization for the given type.
+	template <class T> inline T get(int index) const { return SQLiteTraits<T>::column(m_Cursor, index); }
+
+	// Returns values of columns 0..N-1 as a tuple.
+	template <class... T> inline std::tuple<T...> get() const
+		{ return get<T...>(typename SQLiteMakeIndices<sizeof...(T)>::Type()); }
+
 	inline int numColumns() const noexcept { return sqlite3_column_count(m_Cursor); }
 	inline const char * columnName(int n) const noexcept { return sqlite3_column_name(m_Cursor, n); }
 	inline ColumnType columnType(int n) const noexcept { return ColumnType(sqlite3_column_type(m_Cursor, n)); }
@@ -72,6 +108,9 @@ private:
 	sqlite3_stmt * m_Cursor;
 
 	inline SQLiteCursor(sqlite3_stmt * stmt) noexcept : m_Cursor(stmt) {}
+
+	template <class... T, size_t... N> inline std::tuple<T...> get(SQLiteIndices<N...>) const
+		{ return std::tuple<T...>(SQLiteTraits<T>::column(m_Cursor, int(N))...); }
 	inline ~SQLiteCursor() noexcept {}
 
 	SQLiteCursor(const SQLiteCursor &) = delete;
@@ -79,6 +118,7 @@ private:
 
 	friend class SQLiteDatabase;
 	friend class SQLiteStatement;
+	friend class SQLiteRowRange;
 };
 
 #endif
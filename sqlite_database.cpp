@@ -21,26 +21,40 @@
 // THE SOFTWARE.
 //
 #include "sqlite_database.h"
+#include "sqlite_clock.h"
 #include "sqlite_cursor.h"
+#include "sqlite_virtual_table.h"
 #include <yip-imports/cxx-util/macros.h>
 #include <yip-imports/cxx-util/fmt.h>
 #include <iostream>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <cmath>
 
 /* SQLiteDatabase::Locker */
 
 SQLiteDatabase::Locker::Locker(SQLiteDatabase & db) noexcept
 	: m_Mutex(sqlite3_db_mutex(db.m_Handle)),
-	  m_Locked(false)
+	  m_Database(&db),
+	  m_Profiler(db.m_Profiler),
+	  m_Locked(false),
+	  m_Outermost(false)
 {
 	relock();
 }
 
 SQLiteDatabase::Locker::Locker(sqlite3_stmt * stmt) noexcept
 	: m_Mutex(sqlite3_db_mutex(sqlite3_db_handle(stmt))),
-	  m_Locked(false)
+	  m_Database(nullptr),
+	  m_Profiler(nullptr),
+	  m_Locked(false),
+	  m_Outermost(false)
 {
+	relock();
 }
 
 void SQLiteDatabase::Locker::unlock() noexcept
@@ -48,6 +62,16 @@ void SQLiteDatabase::Locker::unlock() noexcept
 	if (m_Locked)
 	{
 		m_Locked = false;
+		if (m_Database)
+			--m_Database->m_LockDepth;
+
+		// The mutex is recursive: nested lockers are within the hold time of the outermost one
+		if (UNLIKELY(m_Profiler) && m_Outermost)
+		{
+			auto hold = std::chrono::steady_clock::now() - m_LockTime;
+			m_Profiler->recordLock(m_WaitNanoseconds,
+				uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(hold).count()));
+		}
 		sqlite3_mutex_leave(m_Mutex);
 	}
 }
@@ -56,54 +80,128 @@ void SQLiteDatabase::Locker::relock() noexcept
 {
 	if (!m_Locked)
 	{
-		sqlite3_mutex_enter(m_Mutex);
+		if (LIKELY(!m_Profiler))
+			sqlite3_mutex_enter(m_Mutex);
+		else
+		{
+			auto start = std::chrono::steady_clock::now();
+			sqlite3_mutex_enter(m_Mutex);
+			m_LockTime = std::chrono::steady_clock::now();
+			auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(m_LockTime - start);
+			m_WaitNanoseconds = uint64_t(wait.count());
+		}
 		m_Locked = true;
+		if (m_Database)
+			m_Outermost = (m_Database->m_LockDepth++ == 0);
+	}
+}
+
+
+/* SQLiteDatabase::QueryTimer */
+
+void SQLiteDatabase::QueryTimer::report()
+{
+	uint64_t microseconds = SQLiteMicrosecondsSince(m_StartTime);
+
+	// Statements used by the log to explain the query should not show up in statistics of the profiler
+	SQLiteProfiler * profiler = m_Database->m_Profiler;
+	if (LIKELY(!profiler))
+	{
+		m_Log->check(m_Stmt, microseconds);
+		return;
+	}
+
+	m_Database->setTrace(nullptr);
+	try
+	{
+		m_Log->check(m_Stmt, microseconds);
+	}
+	catch (...)
+	{
+		m_Database->setTrace(profiler);
+		throw;
 	}
+	m_Database->setTrace(profiler);
+}
+
+
+/* SQLiteDatabase::BusyPolicy */
+
+SQLiteDatabase::BusyPolicy::BusyPolicy() noexcept
+	: timeoutMilliseconds(5000),
+	  maxRetries(100),
+	  initialDelayMicroseconds(1000),
+	  maxDelayMicroseconds(100000),
+	  backoffMultiplier(2.0),
+	  jitter(0.5)
+{
 }
 
 
 /* SQLiteDatabase */
 
 SQLiteDatabase::SQLiteDatabase(const char * file)
+	: SQLiteDatabase(file, SQLiteOpenOptions())
+{
+}
+
+SQLiteDatabase::SQLiteDatabase(const std::string & file)
+	: SQLiteDatabase(file, SQLiteOpenOptions())
+{
+}
+
+SQLiteDatabase::SQLiteDatabase(const char * file, const SQLiteOpenOptions & options)
 	: m_File(file),
-	  m_StmtBegin(nullptr),
+	  m_Handle(nullptr),
+	  m_StmtBegin(),
 	  m_StmtRollback(nullptr),
 	  m_StmtCommit(nullptr),
 	  m_InTransaction(0),
-	  m_TransactionFailed(false)
+	  m_LockDepth(0),
+	  m_Profiler(nullptr),
+	  m_SlowQueryLog(nullptr)
 {
-	int err = sqlite3_open_v2(file, &m_Handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
-	if (UNLIKELY(err != SQLITE_OK))
-	{
-		throw std::runtime_error(fmt()
-			<< "unable to open sqlite database '" << file << "': " << sqlite3_errstr(err));
-	}
+	open(options);
 }
 
-SQLiteDatabase::SQLiteDatabase(const std::string & file)
+SQLiteDatabase::SQLiteDatabase(const std::string & file, const SQLiteOpenOptions & options)
 	: m_File(file),
-	  m_StmtBegin(nullptr),
+	  m_Handle(nullptr),
+	  m_StmtBegin(),
 	  m_StmtRollback(nullptr),
-	  m_StmtCommit(nullptr)
+	  m_StmtCommit(nullptr),
+	  m_InTransaction(0),
+	  m_LockDepth(0),
+	  m_Profiler(nullptr),
+	  m_SlowQueryLog(nullptr)
 {
-	int err = sqlite3_open_v2(file.c_str(), &m_Handle, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
-	if (UNLIKELY(err != SQLITE_OK))
-	{
-		throw std::runtime_error(fmt()
-			<< "unable to open sqlite database '" << file << "': " << sqlite3_errstr(err));
-	}
+	open(options);
 }
 
 SQLiteDatabase::~SQLiteDatabase()
 {
 	sqlite3_mutex_enter(sqlite3_db_mutex(m_Handle));
 
-	if (m_StmtBegin)
-		sqlite3_finalize(m_StmtBegin);
+	// Statements return their handles to the cache on destruction, they should not outlive the database
+	assert(m_StatementCache.numInUse() == 0);
+
+	for (sqlite3_stmt * stmt : m_StmtBegin)
+	{
+		if (stmt)
+			sqlite3_finalize(stmt);
+	}
 	if (m_StmtRollback)
 		sqlite3_finalize(m_StmtRollback);
 	if (m_StmtCommit)
 		sqlite3_finalize(m_StmtCommit);
+	for (const Savepoint & savepoint : m_Savepoints)
+	{
+		sqlite3_finalize(savepoint.begin);
+		sqlite3_finalize(savepoint.rollback);
+		sqlite3_finalize(savepoint.release);
+	}
+
+	m_StatementCache.flush();
 
 	int err = sqlite3_close(m_Handle);
 	if (err != SQLITE_OK)
@@ -114,11 +212,11 @@ SQLiteDatabase::~SQLiteDatabase()
 	}
 }
 
-void SQLiteDatabase::transaction(const std::function<void()> & protectedCode)
+void SQLiteDatabase::transaction(const std::function<void()> & protectedCode, TransactionKind kind)
 {
 	Locker locker(*this);
 
-	begin(locker);
+	begin(locker, kind);
 	try
 	{
 		if (LIKELY(protectedCode))
@@ -132,6 +230,68 @@ void SQLiteDatabase::transaction(const std::function<void()> & protectedCode)
 	commit(locker);
 }
 
+void SQLiteDatabase::setBusyPolicy(const BusyPolicy & policy)
+{
+	Locker locker(*this);
+	m_BusyPolicy = policy;
+	sqlite3_busy_handler(m_Handle, &SQLiteDatabase::busyHandler, this);
+}
+
+void SQLiteDatabase::clearBusyPolicy()
+{
+	Locker locker(*this);
+	sqlite3_busy_handler(m_Handle, nullptr, nullptr);
+}
+
+void SQLiteDatabase::setProfiler(SQLiteProfiler * profiler)
+{
+	Locker locker(*this);
+	m_Profiler = profiler;
+	setTrace(profiler);
+}
+
+void SQLiteDatabase::setSlowQueryLog(SQLiteSlowQueryLog * log)
+{
+	Locker locker(*this);
+	m_SlowQueryLog = log;
+}
+
+void SQLiteDatabase::removeFunction(const char * name, int numArgs)
+{
+	Locker locker(*this);
+	int err = sqlite3_create_function_v2(m_Handle, name, numArgs, SQLITE_UTF8, nullptr, nullptr, nullptr, nullptr,
+		nullptr);
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		throw std::runtime_error(fmt()
+			<< "unable to remove function '" << name << "': " << sqlite3_errmsg(m_Handle));
+	}
+}
+
+void SQLiteDatabase::createVirtualTable(const char * name, std::unique_ptr<SQLiteVirtualTable> table)
+{
+	Locker locker(*this);
+	int err = sqlite3_create_module_v2(m_Handle, name, SQLiteVirtualTable::module(), table.release(),
+		[](void * table) { delete reinterpret_cast<SQLiteVirtualTable *>(table); });
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		throw std::runtime_error(fmt()
+			<< "unable to create virtual table '" << name << "': " << sqlite3_errmsg(m_Handle));
+	}
+}
+
+SQLiteDatabase::BusyStats SQLiteDatabase::busyStats() const
+{
+	Locker locker(sqlite3_db_mutex(m_Handle));
+	return m_BusyStats;
+}
+
+void SQLiteDatabase::resetBusyStats()
+{
+	Locker locker(*this);
+	memset(&m_BusyStats, 0, sizeof(m_BusyStats));
+}
+
 int64_t SQLiteDatabase::lastInsertId() const
 {
 	return sqlite3_last_insert_rowid(m_Handle);
@@ -141,19 +301,19 @@ void SQLiteDatabase::exec(const char * sql)
 {
 	Locker locker(*this);
 
-	sqlite3_stmt * stmt = nullptr;
+	sqlite3_stmt * stmt = m_StatementCache.acquire(m_Handle, sql);
 	try
 	{
-		prepare(locker, stmt, sql);
 		exec(locker, stmt);
 	}
 	catch (...)
 	{
-		sqlite3_finalize(stmt);
+		locker.relock();
+		m_StatementCache.release(stmt, true);
 		throw;
 	}
 
-	sqlite3_finalize(stmt);
+	m_StatementCache.release(stmt);
 }
 
 void SQLiteDatabase::exec(const std::string & sql)
@@ -162,68 +322,199 @@ void SQLiteDatabase::exec(const std::string & sql)
 }
 
 void SQLiteDatabase::exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow)
+{
+	execCached(sql, NoLimit, onRow);
+}
+
+void SQLiteDatabase::exec(const std::string & sql, const std::function<void(const SQLiteCursor & cursor)> & onRow)
+{
+	execCached(sql.c_str(), NoLimit, onRow);
+}
+
+void SQLiteDatabase::exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow,
+	size_t limit)
+{
+	execCached(sql, limit, onRow);
+}
+
+void SQLiteDatabase::exec(const std::string & sql, const std::function<void(const SQLiteCursor & cursor)> & onRow,
+	size_t limit)
+{
+	execCached(sql.c_str(), limit, onRow);
+}
+
+void SQLiteDatabase::exec(const char * sql, SQLiteResultSet & result)
 {
 	Locker locker(*this);
 
-	sqlite3_stmt * stmt = nullptr;
+	sqlite3_stmt * stmt = m_StatementCache.acquire(m_Handle, sql);
 	try
 	{
-		prepare(locker, stmt, sql);
-		exec(locker, stmt, [stmt, &onRow](){ onRow(SQLiteCursor(stmt)); });
+		exec(locker, stmt, result);
 	}
 	catch (...)
 	{
-		sqlite3_finalize(stmt);
+		m_StatementCache.release(stmt, true);
 		throw;
 	}
 
-	sqlite3_finalize(stmt);
+	m_StatementCache.release(stmt);
 }
 
-void SQLiteDatabase::exec(const std::string & sql, const std::function<void(const SQLiteCursor & cursor)> & onRow)
+void SQLiteDatabase::exec(const std::string & sql, SQLiteResultSet & result)
 {
-	exec(sql.c_str(), onRow);
+	exec(sql.c_str(), result);
 }
 
-void SQLiteDatabase::exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow,
-	size_t limit)
+SQLiteRowBatch::FetchStats SQLiteDatabase::fetchBatches(const char * sql, const BatchCallback & onBatch,
+	size_t batchSize)
 {
 	Locker locker(*this);
 
-	sqlite3_stmt * stmt = nullptr;
+	SQLiteRowBatch::FetchStats stats;
+	sqlite3_stmt * stmt = m_StatementCache.acquire(m_Handle, sql);
 	try
 	{
-		prepare(locker, stmt, sql);
-		exec(locker, stmt, [stmt, &onRow](){ onRow(SQLiteCursor(stmt)); }, limit);
+		stats = fetchBatches(locker, stmt, batchSize, onBatch);
 	}
 	catch (...)
 	{
-		sqlite3_finalize(stmt);
+		locker.relock();
+		m_StatementCache.release(stmt, true);
 		throw;
 	}
 
-	sqlite3_finalize(stmt);
+	locker.relock();
+	m_StatementCache.release(stmt);
+
+	return stats;
 }
 
-void SQLiteDatabase::exec(const std::string & sql, const std::function<void(const SQLiteCursor & cursor)> & onRow,
-	size_t limit)
+SQLiteRowBatch::FetchStats SQLiteDatabase::fetchBatches(const std::string & sql, const BatchCallback & onBatch,
+	size_t batchSize)
+{
+	return fetchBatches(sql.c_str(), onBatch, batchSize);
+}
+
+size_t SQLiteDatabase::statementCacheCapacity() const
+{
+	Locker locker(sqlite3_db_mutex(m_Handle));
+	return m_StatementCache.capacity();
+}
+
+void SQLiteDatabase::setStatementCacheCapacity(size_t capacity)
+{
+	Locker locker(*this);
+	m_StatementCache.setCapacity(capacity);
+}
+
+SQLiteStatementCache::Stats SQLiteDatabase::statementCacheStats() const
+{
+	Locker locker(sqlite3_db_mutex(m_Handle));
+	return m_StatementCache.stats();
+}
+
+void SQLiteDatabase::resetStatementCacheStats()
+{
+	Locker locker(*this);
+	m_StatementCache.resetStats();
+}
+
+void SQLiteDatabase::flushStatementCache()
+{
+	Locker locker(*this);
+	m_StatementCache.flush();
+}
+
+void SQLiteDatabase::open(const SQLiteOpenOptions & options)
 {
-	exec(sql.c_str(), onRow, limit);
+	memset(&m_BusyStats, 0, sizeof(m_BusyStats));
+
+	// Each connection draws its own sequence of busy delays, so colliding processes do not retry in lockstep
+	std::random_device randomDevice;
+	m_BusyRandom.seed(randomDevice() ^ uint32_t(reinterpret_cast<uintptr_t>(this) >> 4));
+
+	const char * vfs = (options.vfs.empty() ? nullptr : options.vfs.c_str());
+	int err = sqlite3_open_v2(m_File.c_str(), &m_Handle, options.flags, vfs);
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		sqlite3_close(m_Handle);
+		throw std::runtime_error(fmt()
+			<< "unable to open sqlite database '" << m_File << "': " << sqlite3_errstr(err));
+	}
+
+	// Options are applied before the database becomes visible to the caller: if any of them fails,
+	// the database is closed and constructor throws.
+	try
+	{
+		std::string pragmas = options.pragmas();
+		if (!pragmas.empty())
+		{
+			char * error = nullptr;
+			err = sqlite3_exec(m_Handle, pragmas.c_str(), nullptr, nullptr, &error);
+			if (UNLIKELY(err != SQLITE_OK))
+			{
+				std::string message = (error ? error : sqlite3_errstr(err));
+				sqlite3_free(error);
+				throw std::runtime_error(fmt()
+					<< "unable to configure sqlite database '" << m_File << "': " << message);
+			}
+		}
+
+		if (options.journalMode == SQLiteOpenOptions::JournalWAL)
+		{
+			bool wal = false;
+			exec("PRAGMA journal_mode", [&wal](const SQLiteCursor & cursor) {
+				const char * mode = cursor.toText(0);
+				wal = (mode && !strcmp(mode, "wal"));
+			});
+			if (UNLIKELY(!wal))
+			{
+				throw std::runtime_error(fmt()
+					<< "unable to enable WAL journal mode for database '" << m_File << "'.");
+			}
+		}
+	}
+	catch (...)
+	{
+		m_StatementCache.flush();
+		sqlite3_close_v2(m_Handle);
+		throw;
+	}
 }
 
-void SQLiteDatabase::begin(Locker & locker)
+void SQLiteDatabase::begin(Locker & locker, TransactionKind kind)
 {
 	if (m_InTransaction)
 	{
 		assert(m_InTransaction > 0);
+
+		// Nested transactions are implemented as savepoints, one set of statements for each nesting level
+		size_t level = size_t(m_InTransaction - 1);
+		if (m_Savepoints.size() <= level)
+		{
+			Savepoint savepoint = { nullptr, nullptr, nullptr };
+			m_Savepoints.resize(level + 1, savepoint);
+		}
+
+		Savepoint & savepoint = m_Savepoints[level];
+		if (UNLIKELY(!savepoint.release))
+		{
+			std::string name = fmt() << "nested_" << m_InTransaction;
+			prepare(locker, savepoint.begin, ("SAVEPOINT " + name).c_str());
+			prepare(locker, savepoint.rollback, ("ROLLBACK TO " + name).c_str());
+			prepare(locker, savepoint.release, ("RELEASE " + name).c_str());
+		}
+
+		exec(locker, savepoint.begin);
 		++m_InTransaction;
 		return;
 	}
 
-	m_TransactionFailed = false;
-	prepare(locker, m_StmtBegin, "BEGIN IMMEDIATE");
+	static const char * const beginSQL[] = { "BEGIN DEFERRED", "BEGIN IMMEDIATE", "BEGIN EXCLUSIVE" };
+	prepare(locker, m_StmtBegin[kind], beginSQL[kind]);
 	prepare(locker, m_StmtRollback, "ROLLBACK");
-	exec(locker, m_StmtBegin);
+	exec(locker, m_StmtBegin[kind]);
 	++m_InTransaction;
 }
 
@@ -232,9 +523,20 @@ void SQLiteDatabase::rollback(Locker & locker)
 	if (UNLIKELY(!m_InTransaction))
 		throw std::runtime_error("attempted to invoke 'rollback' outside of transaction.");
 
-	m_TransactionFailed = true;
-	if (--m_InTransaction == 0)
+	--m_InTransaction;
+
+	// SQLite could have already rolled back the whole transaction (e.g. on SQLITE_FULL)
+	if (UNLIKELY(sqlite3_get_autocommit(m_Handle)))
+		return;
+
+	if (m_InTransaction == 0)
 		exec(locker, m_StmtRollback);
+	else
+	{
+		const Savepoint & savepoint = m_Savepoints[size_t(m_InTransaction - 1)];
+		exec(locker, savepoint.rollback);
+		exec(locker, savepoint.release);
+	}
 }
 
 void SQLiteDatabase::commit(Locker & locker)
@@ -242,12 +544,28 @@ void SQLiteDatabase::commit(Locker & locker)
 	if (UNLIKELY(!m_InTransaction))
 		throw std::runtime_error("attempted to invoke 'commit' outside of transaction.");
 
-	if (--m_InTransaction > 0)
-		return;
+	if (UNLIKELY(sqlite3_get_autocommit(m_Handle)))
+	{
+		--m_InTransaction;
+		throw std::runtime_error("unable to commit transaction: it has already been rolled back.");
+	}
 
-	if (UNLIKELY(m_TransactionFailed))
+	if (--m_InTransaction > 0)
 	{
-		exec(locker, m_StmtRollback);
+		const Savepoint & savepoint = m_Savepoints[size_t(m_InTransaction - 1)];
+		try
+		{
+			exec(locker, savepoint.release);
+		}
+		catch (...)
+		{
+			if (!sqlite3_get_autocommit(m_Handle))
+			{
+				exec(locker, savepoint.rollback);
+				exec(locker, savepoint.release);
+			}
+			throw;
+		}
 		return;
 	}
 
@@ -259,7 +577,8 @@ void SQLiteDatabase::commit(Locker & locker)
 	catch (const std::exception & e)
 	{
 		std::cerr << "error: database commit failed: " << e.what() << std::endl;
-		exec(locker, m_StmtRollback);
+		if (!sqlite3_get_autocommit(m_Handle))
+			exec(locker, m_StmtRollback);
 		throw;
 	}
 }
@@ -277,8 +596,9 @@ void SQLiteDatabase::prepare(Locker &, sqlite3_stmt *& stmt, const char * sql)
 	}
 }
 
-void SQLiteDatabase::exec(Locker &, sqlite3_stmt * stmt)
+void SQLiteDatabase::exec(Locker & locker, sqlite3_stmt * stmt)
 {
+	QueryTimer timer(locker, stmt);
 	try
 	{
 		for (;;)
@@ -287,12 +607,9 @@ void SQLiteDatabase::exec(Locker &, sqlite3_stmt * stmt)
 			if (err == SQLITE_DONE)
 				break;
 			else if (UNLIKELY(err != SQLITE_ROW))
-			{
-				sqlite3 * db = sqlite3_db_handle(stmt);
-				throw std::runtime_error(fmt()
-					<< "unable to execute statement '" << sqlite3_sql(stmt) << "': " << sqlite3_errmsg(db));
-			}
+				throwExecError(stmt);
 		}
+		timer.finish();
 	}
 	catch (...)
 	{
@@ -303,8 +620,10 @@ void SQLiteDatabase::exec(Locker &, sqlite3_stmt * stmt)
 	sqlite3_reset(stmt);
 }
 
-void SQLiteDatabase::exec(Locker & locker, sqlite3_stmt * stmt, const std::function<void()> & onRow)
+void SQLiteDatabase::exec(Locker & locker, sqlite3_stmt * stmt, SQLiteResultSet & result)
 {
+	QueryTimer timer(locker, stmt);
+	result.init(stmt);
 	try
 	{
 		for (;;)
@@ -313,16 +632,11 @@ void SQLiteDatabase::exec(Locker & locker, sqlite3_stmt * stmt, const std::funct
 			if (err == SQLITE_DONE)
 				break;
 			else if (UNLIKELY(err != SQLITE_ROW))
-			{
-				sqlite3 * db = sqlite3_db_handle(stmt);
-				throw std::runtime_error(fmt()
-					<< "unable to execute statement '" << sqlite3_sql(stmt) << "': " << sqlite3_errmsg(db));
-			}
+				throwExecError(stmt);
 
-			locker.unlock();
-			onRow();
-			locker.relock();
+			result.append(stmt);
 		}
+		timer.finish();
 	}
 	catch (...)
 	{
@@ -333,31 +647,82 @@ void SQLiteDatabase::exec(Locker & locker, sqlite3_stmt * stmt, const std::funct
 	sqlite3_reset(stmt);
 }
 
-void SQLiteDatabase::exec(Locker & locker, sqlite3_stmt * stmt, const std::function<void()> & onRow, size_t limit)
+SQLiteRowBatch::FetchStats SQLiteDatabase::fetchBatches(Locker & locker, sqlite3_stmt * stmt, size_t batchSize,
+	const BatchCallback & onBatch)
 {
+	typedef std::chrono::steady_clock clock;
+
+	SQLiteRowBatch::FetchStats stats;
+	stats.numRows = 0;
+	stats.numBatches = 0;
+	stats.lockAcquisitions = 1;
+	stats.lockAcquisitionsSaved = 0;
+	stats.lockWaitMicroseconds = 0;
+	stats.lockHoldMicroseconds = 0;
+	stats.estimatedMicrosecondsSaved = 0;
+
+	bool adaptive = (batchSize == 0);
+	if (adaptive)
+		batchSize = SQLiteRowBatch::InitialAdaptiveBatchSize;
+
+	SQLiteRowBatch batch;
+	batch.init(stmt);
+
+	QueryTimer timer(locker, stmt);
+
 	try
 	{
-		do
+		clock::time_point holdStart = clock::now();
+		for (bool done = false; !done; )
 		{
-			int err = sqlite3_step(stmt);
-			if (err == SQLITE_DONE)
-				break;
-			else if (UNLIKELY(err != SQLITE_ROW))
+			batch.clear();
+			while (batch.numRows() < batchSize)
 			{
-				sqlite3 * db = sqlite3_db_handle(stmt);
-				throw std::runtime_error(fmt()
-					<< "unable to execute statement '" << sqlite3_sql(stmt) << "': " << sqlite3_errmsg(db));
+				int err = sqlite3_step(stmt);
+				if (err == SQLITE_DONE)
+				{
+					done = true;
+					timer.finish();
+					sqlite3_reset(stmt);
+					break;
+				}
+				else if (UNLIKELY(err != SQLITE_ROW))
+					throwExecError(stmt);
+
+				batch.append(stmt);
 			}
 
-			if (limit == 0)
-				break;
-			--limit;
+			uint64_t holdTime = SQLiteMicrosecondsBetween(holdStart, clock::now());
+			stats.lockHoldMicroseconds += holdTime;
+
+			if (adaptive)
+			{
+				if (holdTime < SQLiteRowBatch::AdaptiveTargetHoldMicroseconds / 2
+						&& batchSize < SQLiteRowBatch::MaxAdaptiveBatchSize)
+					batchSize *= 2;
+				else if (holdTime > SQLiteRowBatch::AdaptiveTargetHoldMicroseconds
+						&& batchSize > SQLiteRowBatch::MinAdaptiveBatchSize)
+					batchSize /= 2;
+			}
+
+			if (batch.numRows() > 0)
+			{
+				stats.numRows += batch.numRows();
+				++stats.numBatches;
 
-			locker.unlock();
-			onRow();
-			locker.relock();
+				locker.unlock();
+				onBatch(batch);
+			}
+
+			if (!done)
+			{
+				clock::time_point waitStart = clock::now();
+				locker.relock();
+				holdStart = clock::now();
+				stats.lockWaitMicroseconds += SQLiteMicrosecondsBetween(waitStart, holdStart);
+				++stats.lockAcquisitions;
+			}
 		}
-		while (limit != 0);
 	}
 	catch (...)
 	{
@@ -365,5 +730,99 @@ void SQLiteDatabase::exec(Locker & locker, sqlite3_stmt * stmt, const std::funct
 		throw;
 	}
 
-	sqlite3_reset(stmt);
+	if (stats.numRows + 1 > stats.lockAcquisitions)
+	{
+		stats.lockAcquisitionsSaved = stats.numRows + 1 - stats.lockAcquisitions;
+		stats.estimatedMicrosecondsSaved =
+			stats.lockWaitMicroseconds * stats.lockAcquisitionsSaved / stats.lockAcquisitions;
+	}
+
+	return stats;
+}
+
+void SQLiteDatabase::createFunction(const char * name, int numArgs, int flags, void * data, FunctionCallback func,
+	FunctionCallback step, FunctionResultCallback final, FunctionResultCallback value, FunctionCallback inverse,
+	void (* destroy)(void *))
+{
+	Locker locker(*this);
+
+	int err;
+	if (value)
+	{
+		err = sqlite3_create_window_function(m_Handle, name, numArgs, SQLITE_UTF8 | flags, data, step, final,
+			value, inverse, destroy);
+	}
+	else
+	{
+		err = sqlite3_create_function_v2(m_Handle, name, numArgs, SQLITE_UTF8 | flags, data, func, step, final,
+			destroy);
+	}
+
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		throw std::runtime_error(fmt()
+			<< "unable to create function '" << name << "': " << sqlite3_errmsg(m_Handle));
+	}
+}
+
+void SQLiteDatabase::setTrace(SQLiteProfiler * profiler) noexcept
+{
+	if (!profiler)
+		sqlite3_trace_v2(m_Handle, 0, nullptr, nullptr);
+	else
+	{
+		sqlite3_trace_v2(m_Handle, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW,
+			&SQLiteProfiler::traceCallback, profiler);
+	}
+}
+
+int SQLiteDatabase::busyHandler(void * self, int count)
+{
+	SQLiteDatabase * db = reinterpret_cast<SQLiteDatabase *>(self);
+	const BusyPolicy & policy = db->m_BusyPolicy;
+
+	auto now = std::chrono::steady_clock::now();
+	if (count == 0)
+	{
+		++db->m_BusyStats.busyEvents;
+		db->m_BusyStart = now;
+	}
+
+	if (unsigned(count) >= policy.maxRetries)
+	{
+		++db->m_BusyStats.giveUps;
+		return 0;
+	}
+
+	double delay = double(policy.initialDelayMicroseconds) * pow(policy.backoffMultiplier, double(count));
+	if (delay > double(policy.maxDelayMicroseconds))
+		delay = double(policy.maxDelayMicroseconds);
+	if (policy.jitter > 0.0)
+	{
+		std::uniform_real_distribution<double> distribution(-policy.jitter, policy.jitter);
+		delay *= 1.0 + distribution(db->m_BusyRandom);
+	}
+	if (delay < 0.0)
+		delay = 0.0;
+
+	uint64_t elapsed = SQLiteMicrosecondsBetween(db->m_BusyStart, now);
+	if (elapsed + uint64_t(delay) > uint64_t(policy.timeoutMilliseconds) * 1000)
+	{
+		++db->m_BusyStats.giveUps;
+		return 0;
+	}
+
+	std::this_thread::sleep_for(std::chrono::microseconds(uint64_t(delay)));
+
+	++db->m_BusyStats.retries;
+	db->m_BusyStats.waitMicroseconds += SQLiteMicrosecondsSince(now);
+
+	return 1;
+}
+
+void SQLiteDatabase::throwExecError(sqlite3_stmt * stmt)
+{
+	sqlite3 * db = sqlite3_db_handle(stmt);
+	throw std::runtime_error(fmt()
+		<< "unable to execute statement '" << sqlite3_sql(stmt) << "': " << sqlite3_errmsg(db));
 }
@@ -23,12 +23,27 @@
 #ifndef __c1cb3bca9328a35c1ed67c27131f36bd__
 #define __c1cb3bca9328a35c1ed67c27131f36bd__
 
+#include "sqlite_statement_cache.h"
+#include "sqlite_open_options.h"
+#include "sqlite_profiler.h"
+#include "sqlite_slow_query_log.h"
+#include "sqlite_cursor.h"
+#include "sqlite_function.h"
+#include "sqlite_row_batch.h"
 #include <yip-imports/sqlite3.h>
+#include <yip-imports/cxx-util/macros.h>
 #include <string>
+#include <vector>
+#include <limits>
+#include <random>
+#include <chrono>
 #include <functional>
+#include <memory>
 
-class SQLiteCursor;
 class SQLiteStatement;
+class SQLiteRowRange;
+class SQLiteVirtualTable;
+template <class T> class SQLiteMapper;
 
 class SQLiteDatabase
 {
@@ -38,7 +53,9 @@ public:
 	public:
 		Locker(SQLiteDatabase & db) noexcept;
 		Locker(sqlite3_stmt * stmt) noexcept;
-		inline Locker(sqlite3_mutex * mutex) noexcept : m_Mutex(mutex), m_Locked(false) { relock(); }
+		inline Locker(sqlite3_mutex * mutex) noexcept
+			: m_Mutex(mutex), m_Database(nullptr), m_Profiler(nullptr), m_Locked(false), m_Outermost(false)
+			{ relock(); }
 		inline ~Locker() noexcept { unlock(); }
 
 		void unlock() noexcept;
@@ -46,23 +63,113 @@ public:
 
 	private:
 		sqlite3_mutex * m_Mutex;
+		SQLiteDatabase * m_Database;
+		SQLiteProfiler * m_Profiler;
+		std::chrono::steady_clock::time_point m_LockTime;
+		uint64_t m_WaitNanoseconds;
 		bool m_Locked;
+		bool m_Outermost;
 
 		Locker(const Locker &) = delete;
 		Locker & operator=(const Locker &) = delete;
+
+		friend class SQLiteDatabase;
+	};
+
+	enum TransactionKind
+	{
+		DeferredTransaction = 0,    // Acquires locks on first access; use for read-only transactions
+		ImmediateTransaction,
+		ExclusiveTransaction,
+	};
+
+	// Flags of user-defined functions. Functions should be deterministic to be used in indexes and
+	// CHECK constraints, and innocuous to be used in schema and triggers when trusted_schema is off.
+	enum FunctionFlags
+	{
+		FunctionDeterministic = SQLITE_DETERMINISTIC,
+		FunctionInnocuous = SQLITE_INNOCUOUS,
+		FunctionDirectOnly = SQLITE_DIRECTONLY,
+	};
+
+	// Policy for retrying operations that failed with SQLITE_BUSY. Delay before each retry grows
+	// exponentially from `initialDelayMicroseconds` up to `maxDelayMicroseconds` and is randomized by
+	// +/- `jitter` (a fraction of the delay). Retrying stops after `maxRetries` attempts or when the total wait
+	// would exceed `timeoutMilliseconds`.
+	struct BusyPolicy
+	{
+		unsigned timeoutMilliseconds;
+		unsigned maxRetries;
+		unsigned initialDelayMicroseconds;
+		unsigned maxDelayMicroseconds;
+		double backoffMultiplier;
+		double jitter;
+
+		BusyPolicy() noexcept;
+	};
+
+	struct BusyStats
+	{
+		size_t busyEvents;
+		size_t retries;
+		size_t giveUps;
+		uint64_t waitMicroseconds;
 	};
 
 	SQLiteDatabase(const char * file);
 	SQLiteDatabase(const std::string & file);
+	SQLiteDatabase(const char * file, const SQLiteOpenOptions & options);
+	SQLiteDatabase(const std::string & file, const SQLiteOpenOptions & options);
 	~SQLiteDatabase();
 
 	inline const std::string & fileName() const { return m_File; }
 	inline sqlite3 * handle() const { return m_Handle; }
 
-	void transaction(const std::function<void()> & protectedCode);
+	// Nested transactions are executed as savepoints; `kind` is ignored for them.
+	void transaction(const std::function<void()> & protectedCode, TransactionKind kind = ImmediateTransaction);
+
+	// Installs busy handler implementing the given policy.
+	void setBusyPolicy(const BusyPolicy & policy);
+	void clearBusyPolicy();
+	BusyStats busyStats() const;
+	void resetBusyStats();
+
+	// Starts collecting statement statistics into `profiler`; pass nullptr to stop. Lock times are recorded
+	// only for operations performed through this object and through `SQLiteStatement`.
+	void setProfiler(SQLiteProfiler * profiler);
+	inline SQLiteProfiler * profiler() const { return m_Profiler; }
+
+	// Starts reporting statements executed through this object that take longer than the threshold of `log`;
+	// pass nullptr to stop.
+	void setSlowQueryLog(SQLiteSlowQueryLog * log);
+	inline SQLiteSlowQueryLog * slowQueryLog() const { return m_SlowQueryLog; }
+
+	// Registers scalar function implemented by `func`, e.g. `[](double x, double y) { return x * y; }`.
+	// Arguments and result are converted with SQLiteTraits; exceptions are reported as SQL errors.
+	template <class FUNC> void createFunction(const char * name, int flags, FUNC && func);
+
+	// Registers aggregate function. For each group an accumulator is copied from `initial`, each row is
+	// passed to `step(ACC &, args...)` and the result is returned by `finalize(const ACC &)`.
+	template <class ACC, class STEP, class FINAL> void createAggregate(const char * name, int flags,
+		const ACC & initial, STEP && step, FINAL && finalize);
+
+	// Registers aggregate window function; `inverse(ACC &, args...)` removes a row from the window.
+	template <class ACC, class STEP, class INVERSE, class FINAL> void createWindowFunction(const char * name,
+		int flags, const ACC & initial, STEP && step, INVERSE && inverse, FINAL && finalize);
+
+	void removeFunction(const char * name, int numArgs);
+
+	// Registers read-only eponymous virtual table, see SQLiteContainerTable.
+	void createVirtualTable(const char * name, std::unique_ptr<SQLiteVirtualTable> table);
 
 	int64_t lastInsertId() const;
 
+	size_t statementCacheCapacity() const;
+	void setStatementCacheCapacity(size_t capacity);
+	SQLiteStatementCache::Stats statementCacheStats() const;
+	void resetStatementCacheStats();
+	void flushStatementCache();
+
 	void exec(const char * sql);
 	void exec(const std::string & sql);
 	void exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow);
@@ -70,31 +177,195 @@ public:
 	void exec(const char * sql, const std::function<void(const SQLiteCursor & cursor)> & onRow, size_t limit);
 	void exec(const std::string & sql, const std::function<void(const SQLiteCursor & cursor)> & onRow, size_t limit);
 
+	// Materializes all rows returned by the query into the result set, replacing its previous contents.
+	void exec(const char * sql, SQLiteResultSet & result);
+	void exec(const std::string & sql, SQLiteResultSet & result);
+
+	// Overloads accepting any callable with signature `void(const SQLiteCursor &)`. The row loop is
+	// instantiated for the callable type, so the callback could be inlined.
+	template <class FUNC> inline void exec(const char * sql, FUNC && onRow)
+		{ execCached(sql, NoLimit, onRow); }
+	template <class FUNC> inline void exec(const std::string & sql, FUNC && onRow)
+		{ execCached(sql.c_str(), NoLimit, onRow); }
+	template <class FUNC> inline void exec(const char * sql, FUNC && onRow, size_t limit)
+		{ execCached(sql, limit, onRow); }
+	template <class FUNC> inline void exec(const std::string & sql, FUNC && onRow, size_t limit)
+		{ execCached(sql.c_str(), limit, onRow); }
+
+	// Steps up to `batchSize` rows under a single lock acquisition, copies them into a reusable buffer and
+	// invokes the callback with the lock released. If `batchSize` is 0, batch size is adjusted automatically
+	// to keep the lock hold time for each batch around SQLiteRowBatch::AdaptiveTargetHoldMicroseconds.
+	typedef std::function<void(const SQLiteRowBatch & batch)> BatchCallback;
+	SQLiteRowBatch::FetchStats fetchBatches(const char * sql, const BatchCallback & onBatch, size_t batchSize = 0);
+	SQLiteRowBatch::FetchStats fetchBatches(const std::string & sql, const BatchCallback & onBatch,
+		size_t batchSize = 0);
+
 private:
+	// Measures execution of a statement for the slow query log.
+	class QueryTimer
+	{
+	public:
+		inline QueryTimer(Locker & locker, sqlite3_stmt * stmt) noexcept
+			: m_Database(locker.m_Database), m_Log(m_Database ? m_Database->m_SlowQueryLog : nullptr), m_Stmt(stmt)
+			{ if (UNLIKELY(m_Log)) m_StartTime = std::chrono::steady_clock::now(); }
+
+		// Should be called with the database locked, before the statement is reset.
+		inline void finish() { if (UNLIKELY(m_Log)) report(); }
+
+	private:
+		SQLiteDatabase * m_Database;
+		SQLiteSlowQueryLog * m_Log;
+		sqlite3_stmt * m_Stmt;
+		std::chrono::steady_clock::time_point m_StartTime;
+
+		void report();
+	};
+
+	struct Savepoint
+	{
+		sqlite3_stmt * begin;
+		sqlite3_stmt * rollback;
+		sqlite3_stmt * release;
+	};
+
+	static const size_t NoLimit = std::numeric_limits<size_t>::max();
+
 	std::string m_File;
 	sqlite3 * m_Handle;
-	sqlite3_stmt * m_StmtBegin;
+	sqlite3_stmt * m_StmtBegin[3];
 	sqlite3_stmt * m_StmtRollback;
 	sqlite3_stmt * m_StmtCommit;
+	SQLiteStatementCache m_StatementCache;
+	std::vector<Savepoint> m_Savepoints;
 	int m_InTransaction;
-	bool m_TransactionFailed;
+	int m_LockDepth;    // Number of Lockers of this object holding the (recursive) mutex
+	BusyPolicy m_BusyPolicy;
+	BusyStats m_BusyStats;
+	std::chrono::steady_clock::time_point m_BusyStart;
+	std::minstd_rand m_BusyRandom;
+	SQLiteProfiler * m_Profiler;
+	SQLiteSlowQueryLog * m_SlowQueryLog;
 
-	void begin(Locker & locker);
+	void open(const SQLiteOpenOptions & options);
+
+	void begin(Locker & locker, TransactionKind kind = ImmediateTransaction);
 	void rollback(Locker & locker);
 	void commit(Locker & locker);
 
 	void prepare(Locker & locker, sqlite3_stmt *& stmt, const char * sql);
 
 	static void exec(Locker & locker, sqlite3_stmt * stmt);
-	static void exec(Locker & locker, sqlite3_stmt * stmt, const std::function<void()> & onRow);
-	static void exec(Locker & locker, sqlite3_stmt * stmt, const std::function<void()> & onRow, size_t limit);
+	static void exec(Locker & locker, sqlite3_stmt * stmt, SQLiteResultSet & result);
+
+	template <class FUNC> void execCached(const char * sql, size_t limit, FUNC & onRow);
+	template <class FUNC> static void execRows(Locker & locker, sqlite3_stmt * stmt, size_t limit, FUNC && onRow);
+	[[noreturn]] static void throwExecError(sqlite3_stmt * stmt);
+
+	void setTrace(SQLiteProfiler * profiler) noexcept;
+	static int busyHandler(void * self, int count);
+
+	typedef void (* FunctionCallback)(sqlite3_context * context, int argc, sqlite3_value ** argv);
+	typedef void (* FunctionResultCallback)(sqlite3_context * context);
+
+	// Takes ownership of `data`: it is released with `destroy` even if registration fails.
+	void createFunction(const char * name, int numArgs, int flags, void * data, FunctionCallback func,
+		FunctionCallback step, FunctionResultCallback final, FunctionResultCallback value,
+		FunctionCallback inverse, void (* destroy)(void *));
+
+	static SQLiteRowBatch::FetchStats fetchBatches(Locker & locker, sqlite3_stmt * stmt, size_t batchSize,
+		const BatchCallback & onBatch);
 
 	SQLiteDatabase(const SQLiteDatabase &) = delete;
 	SQLiteDatabase & operator=(const SQLiteDatabase &) = delete;
 
 	friend class SQLiteCursor;
 	friend class SQLiteStatement;
+	friend class SQLiteRowRange;
 	friend class SQLiteDatabase::Locker;
+	template <class T> friend class SQLiteMapper;
 };
 
+template <class FUNC> void SQLiteDatabase::execCached(const char * sql, size_t limit, FUNC & onRow)
+{
+	Locker locker(*this);
+
+	sqlite3_stmt * stmt = m_StatementCache.acquire(m_Handle, sql);
+	try
+	{
+		execRows(locker, stmt, limit, [stmt, &onRow](){ onRow(SQLiteCursor(stmt)); });
+	}
+	catch (...)
+	{
+		locker.relock();
+		m_StatementCache.release(stmt, true);
+		throw;
+	}
+
+	m_StatementCache.release(stmt);
+}
+
+template <class FUNC> void SQLiteDatabase::execRows(Locker & locker, sqlite3_stmt * stmt, size_t limit,
+	FUNC && onRow)
+{
+	QueryTimer timer(locker, stmt);
+	try
+	{
+		do
+		{
+			int err = sqlite3_step(stmt);
+			if (err == SQLITE_DONE)
+				break;
+			else if (UNLIKELY(err != SQLITE_ROW))
+				throwExecError(stmt);
+
+			if (limit == 0)
+				break;
+			--limit;
+
+			locker.unlock();
+			onRow();
+			locker.relock();
+		}
+		while (limit != 0);
+		timer.finish();
+	}
+	catch (...)
+	{
+		sqlite3_reset(stmt);
+		throw;
+	}
+
+	sqlite3_reset(stmt);
+}
+
+template <class FUNC> void SQLiteDatabase::createFunction(const char * name, int flags, FUNC && func)
+{
+	typedef SQLiteScalarFunction<typename std::decay<FUNC>::type> Function;
+	createFunction(name, Function::NumArguments, flags, new Function(std::forward<FUNC>(func)),
+		&Function::call, nullptr, nullptr, nullptr, nullptr, &Function::destroy);
+}
+
+template <class ACC, class STEP, class FINAL> void SQLiteDatabase::createAggregate(const char * name, int flags,
+	const ACC & initial, STEP && step, FINAL && finalize)
+{
+	typedef SQLiteAggregateFunction<ACC, typename std::decay<STEP>::type, std::nullptr_t,
+		typename std::decay<FINAL>::type> Function;
+	createFunction(name, Function::NumArguments, flags,
+		new Function(initial, std::forward<STEP>(step), nullptr, std::forward<FINAL>(finalize)),
+		nullptr, &Function::step, &Function::finalize, nullptr, nullptr, &Function::destroy);
+}
+
+template <class ACC, class STEP, class INVERSE, class FINAL> void SQLiteDatabase::createWindowFunction(
+	const char * name, int flags, const ACC & initial, STEP && step, INVERSE && inverse, FINAL && finalize)
+{
+	typedef SQLiteAggregateFunction<ACC, typename std::decay<STEP>::type, typename std::decay<INVERSE>::type,
+		typename std::decay<FINAL>::type> Function;
+	static_assert(int(SQLiteCallableTraits<typename std::decay<INVERSE>::type>::NumArguments)
+		== int(Function::NumArguments) + 1, "step and inverse functions should accept the same arguments.");
+	Function * function = new Function(initial, std::forward<STEP>(step), std::forward<INVERSE>(inverse),
+		std::forward<FINAL>(finalize));
+	createFunction(name, Function::NumArguments, flags, function, nullptr, &Function::step, &Function::finalize,
+		&Function::value, &Function::inverse, &Function::destroy);
+}
+
 #endif
@@ -0,0 +1,592 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_exporter.h"
+#include "sqlite_clock.h"
+#include "sqlite_database.h"
+#include "sqlite_statement.h"
+#include "sqlite_cursor.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __cplusplus >= 201703L
+ #include <charconv>
+#endif
+
+namespace
+{
+	const size_t MaxNumberLength = 32;
+
+	const char g_DigitPairs[201] =
+		"0001020304050607080910111213141516171819202122232425262728293031323334353637383940414243444546474849"
+		"5051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899";
+
+	const char g_HexDigits[] = "0123456789abcdef";
+
+	char * formatInteger(char * out, sqlite3_int64 value) noexcept
+	{
+		uint64_t n = uint64_t(value);
+		if (value < 0)
+		{
+			*out++ = '-';
+			n = 0 - n;
+		}
+
+		char buffer[20];
+		char * p = buffer + sizeof(buffer);
+		while (n >= 100)
+		{
+			const char * pair = &g_DigitPairs[(n % 100) * 2];
+			n /= 100;
+			*--p = pair[1];
+			*--p = pair[0];
+		}
+		if (n < 10)
+			*--p = char('0' + n);
+		else
+		{
+			const char * pair = &g_DigitPairs[n * 2];
+			*--p = pair[1];
+			*--p = pair[0];
+		}
+
+		size_t length = size_t(buffer + sizeof(buffer) - p);
+		memcpy(out, p, length);
+		return out + length;
+	}
+
+	// Shortest text that reads back as the same double. Like SQLite, reals always have a fraction or exponent.
+	char * formatReal(char * out, double value) noexcept
+	{
+		if (value == std::floor(value) && std::fabs(value) < 1e15)
+		{
+			if (std::signbit(value) && value == 0.0)
+				*out++ = '-';
+			out = formatInteger(out, sqlite3_int64(value));
+			*out++ = '.';
+			*out++ = '0';
+			return out;
+		}
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+		char * end = std::to_chars(out, out + MaxNumberLength, value).ptr;
+#else
+		int length = snprintf(out, MaxNumberLength, "%.15g", value);
+		if (strtod(out, nullptr) != value)
+			length = snprintf(out, MaxNumberLength, "%.17g", value);
+		char * end = out + length;
+#endif
+
+		for (const char * p = out; p < end; ++p)
+		{
+			if (*p == '.' || *p == 'e' || *p == 'E')
+				return end;
+		}
+
+		*end++ = '.';
+		*end++ = '0';
+		return end;
+	}
+
+	// Worst case output is twice as long as the input.
+	char * escapeCSV(char * out, const char * p, size_t length, char quote) noexcept
+	{
+		for (const char * end = p + length; p < end; ++p)
+		{
+			if (*p == quote)
+				*out++ = quote;
+			*out++ = *p;
+		}
+		return out;
+	}
+
+	// Worst case output is six times as long as the input.
+	char * escapeJSON(char * out, const char * p, size_t length) noexcept
+	{
+		for (const char * end = p + length; p < end; ++p)
+		{
+			unsigned char ch = (unsigned char)*p;
+			if (LIKELY(ch >= 0x20 && ch != '"' && ch != '\\'))
+			{
+				*out++ = char(ch);
+				continue;
+			}
+
+			*out++ = '\\';
+			switch (ch)
+			{
+			case '"': *out++ = '"'; break;
+			case '\\': *out++ = '\\'; break;
+			case '\b': *out++ = 'b'; break;
+			case '\f': *out++ = 'f'; break;
+			case '\n': *out++ = 'n'; break;
+			case '\r': *out++ = 'r'; break;
+			case '\t': *out++ = 't'; break;
+			default:
+				*out++ = 'u';
+				*out++ = '0';
+				*out++ = '0';
+				*out++ = g_HexDigits[ch >> 4];
+				*out++ = g_HexDigits[ch & 15];
+			}
+		}
+		return out;
+	}
+
+	inline bool needsCSVQuotes(const char * p, size_t length, char delimiter, char quote) noexcept
+	{
+		if (length == 0)
+			return true;
+		for (const char * end = p + length; p < end; ++p)
+		{
+			char ch = *p;
+			if (ch == delimiter || ch == quote || ch == '\n' || ch == '\r')
+				return true;
+		}
+		return false;
+	}
+}
+
+SQLiteExporter::Options::Options() noexcept
+	: format(CSV),
+	  delimiter(','),
+	  quote('"'),
+	  header(true),
+	  crlf(false),
+	  bufferSize(DefaultBufferSize)
+{
+}
+
+SQLiteExporter::SQLiteExporter(int fd, const Options & options)
+	: m_Options(options),
+	  m_Size(0),
+	  m_FD(fd)
+{
+	if (m_Options.bufferSize < MinBufferSize)
+		m_Options.bufferSize = MinBufferSize;
+
+	m_Buffer.resize(m_Options.bufferSize);
+	m_LargeValueSize = m_Options.bufferSize / 4;
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+SQLiteExporter::~SQLiteExporter()
+{
+}
+
+SQLiteExporter::Stats SQLiteExporter::exportQuery(SQLiteDatabase & database, const std::string & sql)
+{
+	SQLiteStatement statement(database, sql);
+	return exportStatement(statement);
+}
+
+SQLiteExporter::Stats SQLiteExporter::exportStatement(const SQLiteStatement & statement)
+{
+	SQLiteClock::time_point startTime = SQLiteClock::now();
+
+	memset(&m_Stats, 0, sizeof(m_Stats));
+	m_Size = 0;
+
+	try
+	{
+		sqlite3_stmt * stmt = statement.handle();
+		int numColumns = sqlite3_column_count(stmt);
+		writeHeader(stmt);
+
+		switch (m_Options.format)
+		{
+		case CSV:
+			statement.exec([this, numColumns](const SQLiteCursor & cursor) { writeCSVRow(cursor, numColumns); });
+			break;
+
+		case NDJSON:
+			statement.exec([this, numColumns](const SQLiteCursor & cursor) { writeJSONRow(cursor, numColumns); });
+			break;
+
+		case Binary:
+			statement.exec([this, numColumns](const SQLiteCursor & cursor) {
+				writeBinaryRow(cursor, numColumns);
+			});
+			break;
+		}
+
+		flush();
+	}
+	catch (...)
+	{
+		m_Size = 0;
+		throw;
+	}
+
+	m_Stats.microseconds = SQLiteMicrosecondsSince(startTime);
+
+	return m_Stats;
+}
+
+void SQLiteExporter::writeHeader(sqlite3_stmt * stmt)
+{
+	int numColumns = sqlite3_column_count(stmt);
+
+	switch (m_Options.format)
+	{
+	case CSV:
+		if (!m_Options.header || numColumns == 0)
+			return;
+		for (int i = 0; i < numColumns; i++)
+		{
+			if (i > 0)
+				put(m_Options.delimiter);
+			const char * name = sqlite3_column_name(stmt, i);
+			writeCSVText(name, strlen(name));
+		}
+		if (m_Options.crlf)
+			put('\r');
+		put('\n');
+		return;
+
+	case NDJSON:
+		m_Keys.resize(size_t(numColumns));
+		for (int i = 0; i < numColumns; i++)
+		{
+			const char * name = sqlite3_column_name(stmt, i);
+			size_t length = strlen(name);
+
+			std::string & key = m_Keys[size_t(i)];
+			key.resize(length * 6 + 4);
+			key[0] = (i == 0 ? '{' : ',');
+			key[1] = '"';
+			char * end = escapeJSON(&key[2], name, length);
+			*end++ = '"';
+			*end++ = ':';
+			key.resize(size_t(end - &key[0]));
+		}
+		return;
+
+	case Binary:
+		writeRaw("SQLB\x01", 5);
+		writeVarint(uint64_t(numColumns));
+		for (int i = 0; i < numColumns; i++)
+		{
+			const char * name = sqlite3_column_name(stmt, i);
+			size_t length = strlen(name);
+			writeVarint(length);
+			writeRaw(name, length);
+		}
+		return;
+	}
+}
+
+void SQLiteExporter::writeCSVRow(const SQLiteCursor & cursor, int numColumns)
+{
+	for (int i = 0; i < numColumns; i++)
+	{
+		if (i > 0)
+			put(m_Options.delimiter);
+
+		switch (cursor.columnType(i))
+		{
+		case SQLiteCursor::ColumnInt:
+			commit(formatInteger(reserve(MaxNumberLength), cursor.toInt64(i)));
+			break;
+
+		case SQLiteCursor::ColumnFloat: {
+			double value = cursor.toDouble(i);
+			if (UNLIKELY(std::isinf(value)))
+				writeRaw(value < 0 ? "-Inf" : "Inf", value < 0 ? 4 : 3);
+			else
+				commit(formatReal(reserve(MaxNumberLength), value));
+			break;
+			}
+
+		case SQLiteCursor::ColumnText: {
+			const char * text = cursor.toText(i);
+			writeCSVText(text, cursor.columnBytes(i));
+			break;
+			}
+
+		case SQLiteCursor::ColumnBlob: {
+			const void * data = cursor.toBlob(i);
+			size_t size = cursor.columnBytes(i);
+			if (size == 0)
+				writeCSVText("", 0);
+			else
+				writeHex(data, size);
+			break;
+			}
+
+		case SQLiteCursor::ColumnNull:
+			break;
+		}
+	}
+
+	if (m_Options.crlf)
+		put('\r');
+	put('\n');
+
+	++m_Stats.rows;
+}
+
+void SQLiteExporter::writeJSONRow(const SQLiteCursor & cursor, int numColumns)
+{
+	if (UNLIKELY(numColumns == 0))
+		put('{');
+
+	for (int i = 0; i < numColumns; i++)
+	{
+		const std::string & key = m_Keys[size_t(i)];
+		writeRaw(key.data(), key.length());
+
+		switch (cursor.columnType(i))
+		{
+		case SQLiteCursor::ColumnInt:
+			commit(formatInteger(reserve(MaxNumberLength), cursor.toInt64(i)));
+			break;
+
+		case SQLiteCursor::ColumnFloat: {
+			double value = cursor.toDouble(i);
+			if (UNLIKELY(std::isinf(value)))
+				writeRaw("null", 4);
+			else
+				commit(formatReal(reserve(MaxNumberLength), value));
+			break;
+			}
+
+		case SQLiteCursor::ColumnText: {
+			const char * text = cursor.toText(i);
+			writeJSONText(text, cursor.columnBytes(i));
+			break;
+			}
+
+		case SQLiteCursor::ColumnBlob: {
+			const void * data = cursor.toBlob(i);
+			put('"');
+			writeHex(data, cursor.columnBytes(i));
+			put('"');
+			break;
+			}
+
+		case SQLiteCursor::ColumnNull:
+			writeRaw("null", 4);
+			break;
+		}
+	}
+
+	char * out = reserve(2);
+	*out++ = '}';
+	*out++ = '\n';
+	commit(out);
+
+	++m_Stats.rows;
+}
+
+void SQLiteExporter::writeBinaryRow(const SQLiteCursor & cursor, int numColumns)
+{
+	for (int i = 0; i < numColumns; i++)
+	{
+		SQLiteCursor::ColumnType type = cursor.columnType(i);
+		put(char(type));
+
+		switch (type)
+		{
+		case SQLiteCursor::ColumnInt: {
+			uint64_t value = uint64_t(cursor.toInt64(i));
+			writeVarint((value << 1) ^ (0 - (value >> 63)));
+			break;
+			}
+
+		case SQLiteCursor::ColumnFloat: {
+			double value = cursor.toDouble(i);
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			char * out = reserve(8);
+			for (int j = 0; j < 8; j++, bits >>= 8)
+				*out++ = char(bits & 0xFF);
+			commit(out);
+			break;
+			}
+
+		case SQLiteCursor::ColumnText: {
+			const char * text = cursor.toText(i);
+			size_t length = cursor.columnBytes(i);
+			writeVarint(length);
+			writeRaw(text, length);
+			break;
+			}
+
+		case SQLiteCursor::ColumnBlob: {
+			const void * data = cursor.toBlob(i);
+			size_t size = cursor.columnBytes(i);
+			writeVarint(size);
+			writeRaw(data, size);
+			break;
+			}
+
+		case SQLiteCursor::ColumnNull:
+			break;
+		}
+	}
+
+	++m_Stats.rows;
+}
+
+void SQLiteExporter::writeCSVText(const char * text, size_t length)
+{
+	if (!needsCSVQuotes(text, length, m_Options.delimiter, m_Options.quote))
+	{
+		writeRaw(text, length);
+		return;
+	}
+
+	put(m_Options.quote);
+	const size_t segmentSize = m_Buffer.size() / 4;
+	while (length > 0)
+	{
+		size_t size = (length < segmentSize ? length : segmentSize);
+		commit(escapeCSV(reserve(size * 2), text, size, m_Options.quote));
+		text += size;
+		length -= size;
+	}
+	put(m_Options.quote);
+}
+
+void SQLiteExporter::writeJSONText(const char * text, size_t length)
+{
+	put('"');
+	const size_t segmentSize = m_Buffer.size() / 8;
+	while (length > 0)
+	{
+		size_t size = (length < segmentSize ? length : segmentSize);
+		commit(escapeJSON(reserve(size * 6), text, size));
+		text += size;
+		length -= size;
+	}
+	put('"');
+}
+
+void SQLiteExporter::writeHex(const void * data, size_t size)
+{
+	const unsigned char * p = static_cast<const unsigned char *>(data);
+	const size_t segmentSize = m_Buffer.size() / 4;
+	while (size > 0)
+	{
+		size_t length = (size < segmentSize ? size : segmentSize);
+		char * out = reserve(length * 2);
+		for (const unsigned char * end = p + length; p < end; ++p)
+		{
+			*out++ = g_HexDigits[*p >> 4];
+			*out++ = g_HexDigits[*p & 15];
+		}
+		commit(out);
+		size -= length;
+	}
+}
+
+void SQLiteExporter::writeRaw(const void * data, size_t size)
+{
+	if (LIKELY(size < m_LargeValueSize))
+	{
+		memcpy(reserve(size), data, size);
+		m_Size += size;
+		return;
+	}
+
+	// Large value: write it together with the buffered data without copying
+	struct iovec iov[2];
+	iov[0].iov_base = m_Buffer.data();
+	iov[0].iov_len = m_Size;
+	iov[1].iov_base = const_cast<void *>(data);
+	iov[1].iov_len = size;
+	m_Size = 0;
+	writeAll(iov, 2);
+}
+
+void SQLiteExporter::writeVarint(uint64_t value)
+{
+	char * out = reserve(10);
+	while (value >= 0x80)
+	{
+		*out++ = char((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	*out++ = char(value);
+	commit(out);
+}
+
+void SQLiteExporter::flush()
+{
+	if (m_Size == 0)
+		return;
+
+	struct iovec iov;
+	iov.iov_base = m_Buffer.data();
+	iov.iov_len = m_Size;
+	m_Size = 0;
+	writeAll(&iov, 1);
+}
+
+void SQLiteExporter::writeAll(struct iovec * iov, int count)
+{
+	for (;;)
+	{
+		while (count > 0 && iov->iov_len == 0)
+		{
+			++iov;
+			--count;
+		}
+		if (count == 0)
+			return;
+
+		ssize_t result = writev(m_FD, iov, count);
+		if (UNLIKELY(result <= 0))
+		{
+			if (result < 0 && errno == EINTR)
+				continue;
+			throw std::runtime_error(fmt() << "unable to write exported data: "
+				<< (result < 0 ? strerror(errno) : "nothing was written"));
+		}
+
+		++m_Stats.writeCalls;
+		m_Stats.bytesWritten += uint64_t(result);
+
+		size_t written = size_t(result);
+		while (count > 0 && written >= iov->iov_len)
+		{
+			written -= iov->iov_len;
+			++iov;
+			--count;
+		}
+		if (count > 0)
+		{
+			iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+			iov->iov_len -= written;
+		}
+	}
+}
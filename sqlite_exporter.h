@@ -0,0 +1,139 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __4aa7ba516086c2d866d9b35453b0e076__
+#define __4aa7ba516086c2d866d9b35453b0e076__
+
+#include <yip-imports/sqlite3.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SQLiteDatabase;
+class SQLiteStatement;
+class SQLiteCursor;
+struct iovec;
+
+// Streams rows of a statement to a file descriptor. Values are formatted and escaped directly into a large
+// output buffer that is reused between exports and flushed with large write(2) / writev(2) calls; values
+// larger than a quarter of the buffer are written straight from SQLite memory where possible.
+//
+// CSV: NULL is written as an empty field and empty text as "", so that NULL survives a round trip through
+// SQLiteImporter with `emptyAsNull` set. Blobs are written as hex digits.
+//
+// NDJSON: one object per row keyed by column names. Blobs are written as strings of hex digits, infinite
+// reals as null. Text is expected to be valid UTF-8 and is not validated.
+//
+// Binary: "SQLB", a version byte (1), varint number of columns and the column names (each as varint length
+// followed by UTF-8 bytes). Then, for each row, each value as a type byte (SQLITE_INTEGER, SQLITE_FLOAT,
+// SQLITE_TEXT, SQLITE_BLOB or SQLITE_NULL) followed by a zigzag varint for integers, 8 little-endian bytes of
+// IEEE 754 double for reals, and varint length followed by bytes for text and blobs. Varints are LEB128.
+class SQLiteExporter
+{
+public:
+	enum Format
+	{
+		CSV = 0,
+		NDJSON,
+		Binary,
+	};
+
+	enum
+	{
+		DefaultBufferSize = 1024 * 1024,
+		MinBufferSize = 4096,
+	};
+
+	struct Options
+	{
+		Format format;
+		char delimiter;
+		char quote;
+		bool header;                // CSV only: write column names as the first line
+		bool crlf;                  // CSV only: terminate lines with CR LF instead of LF
+		size_t bufferSize;
+
+		Options() noexcept;
+	};
+
+	struct Stats
+	{
+		size_t rows;
+		uint64_t bytesWritten;
+		size_t writeCalls;
+		uint64_t microseconds;
+
+		inline double rowsPerSecond() const noexcept
+			{ return microseconds > 0 ? double(rows) * 1000000.0 / double(microseconds) : 0.0; }
+		inline double megabytesPerSecond() const noexcept
+			{ return microseconds > 0 ? double(bytesWritten) / double(microseconds) : 0.0; }
+	};
+
+	// The descriptor should be blocking. It is not closed by the exporter.
+	SQLiteExporter(int fd, const Options & options = Options());
+	~SQLiteExporter();
+
+	// Writes all rows of the query and flushes the buffer. Rows written before a failure stay written.
+	Stats exportQuery(SQLiteDatabase & database, const std::string & sql);
+
+	// Same for a prepared statement with its parameters already bound. The statement is reset afterwards.
+	Stats exportStatement(const SQLiteStatement & statement);
+
+private:
+	Options m_Options;
+	std::vector<char> m_Buffer;
+	std::vector<std::string> m_Keys;
+	Stats m_Stats;
+	size_t m_Size;
+	size_t m_LargeValueSize;
+	int m_FD;
+
+	inline char * reserve(size_t size)
+	{
+		if (m_Size + size > m_Buffer.size())
+			flush();
+		return m_Buffer.data() + m_Size;
+	}
+
+	inline void commit(char * end) noexcept { m_Size = size_t(end - m_Buffer.data()); }
+
+	inline void put(char ch) { *reserve(1) = ch; ++m_Size; }
+
+	void writeHeader(sqlite3_stmt * stmt);
+	void writeCSVRow(const SQLiteCursor & cursor, int numColumns);
+	void writeJSONRow(const SQLiteCursor & cursor, int numColumns);
+	void writeBinaryRow(const SQLiteCursor & cursor, int numColumns);
+
+	void writeCSVText(const char * text, size_t length);
+	void writeJSONText(const char * text, size_t length);
+	void writeHex(const void * data, size_t size);
+	void writeRaw(const void * data, size_t size);
+	void writeVarint(uint64_t value);
+
+	void flush();
+	void writeAll(struct iovec * iov, int count);
+
+	SQLiteExporter(const SQLiteExporter &) = delete;
+	SQLiteExporter & operator=(const SQLiteExporter &) = delete;
+};
+
+#endif
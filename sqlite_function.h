@@ -0,0 +1,204 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __b90da3577c3ad9de87cc10a6b06dd46a__
+#define __b90da3577c3ad9de87cc10a6b06dd46a__
+
+#include "sqlite_traits.h"
+#include <yip-imports/sqlite3.h>
+#include <type_traits>
+#include <stdexcept>
+#include <utility>
+#include <tuple>
+#include <new>
+
+// Adapters between C++ callables and user-defined SQLite functions, see SQLiteDatabase::createFunction.
+// Arguments are extracted with `SQLiteTraits<T>::value` and results are set with `SQLiteTraits<T>::result`.
+
+// Result type and argument types of a function, function pointer, lambda or other function object.
+template <class T> struct SQLiteCallableTraits : SQLiteCallableTraits<decltype(&T::operator())> {};
+
+template <class R, class... ARGS> struct SQLiteCallableTraits<R (*)(ARGS...)>
+{
+	typedef R Result;
+	typedef std::tuple<ARGS...> Arguments;
+	enum { NumArguments = sizeof...(ARGS) };
+};
+
+template <class R, class... ARGS> struct SQLiteCallableTraits<R (ARGS...)>
+	: SQLiteCallableTraits<R (*)(ARGS...)> {};
+template <class C, class R, class... ARGS> struct SQLiteCallableTraits<R (C::*)(ARGS...)>
+	: SQLiteCallableTraits<R (*)(ARGS...)> {};
+template <class C, class R, class... ARGS> struct SQLiteCallableTraits<R (C::*)(ARGS...) const>
+	: SQLiteCallableTraits<R (*)(ARGS...)> {};
+
+// Calls `func` with arguments from `argv`. Argument N of the callable is taken from argv[N - FIRST].
+template <size_t FIRST, class FUNC, class... EXTRA, size_t... N>
+inline typename SQLiteCallableTraits<FUNC>::Result SQLiteInvokeFunction(FUNC & func, sqlite3_value ** argv,
+	SQLiteIndices<N...>, EXTRA &... extra)
+{
+	typedef typename SQLiteCallableTraits<FUNC>::Arguments Arguments;
+	return func(extra..., SQLiteTraits<typename std::decay<typename std::tuple_element<N + FIRST,
+		Arguments>::type>::type>::value(argv[N])...);
+}
+
+template <class R> struct SQLiteFunctionResult
+{
+	template <class FUNC> static inline void set(sqlite3_context * context, FUNC && func)
+		{ SQLiteTraits<typename std::decay<R>::type>::result(context, func()); }
+};
+
+template <> struct SQLiteFunctionResult<void>
+{
+	template <class FUNC> static inline void set(sqlite3_context * context, FUNC && func)
+	{
+		func();
+		sqlite3_result_null(context);
+	}
+};
+
+// Exceptions must not propagate into SQLite; they are reported as errors of the SQL statement instead.
+template <class FUNC> inline void SQLiteFunctionGuard(sqlite3_context * context, FUNC && body) noexcept
+{
+	try
+	{
+		body();
+	}
+	catch (const std::bad_alloc &)
+	{
+		sqlite3_result_error_nomem(context);
+	}
+	catch (const std::exception & e)
+	{
+		sqlite3_result_error(context, e.what(), -1);
+	}
+	catch (...)
+	{
+		sqlite3_result_error(context, "unknown exception in user-defined function.", -1);
+	}
+}
+
+template <class FUNC> struct SQLiteScalarFunction
+{
+	typedef SQLiteCallableTraits<FUNC> Traits;
+	enum { NumArguments = Traits::NumArguments };
+
+	FUNC func;
+
+	template <class F> explicit SQLiteScalarFunction(F && f) : func(std::forward<F>(f)) {}
+
+	static void call(sqlite3_context * context, int, sqlite3_value ** argv) noexcept
+	{
+		SQLiteScalarFunction * self = reinterpret_cast<SQLiteScalarFunction *>(sqlite3_user_data(context));
+		SQLiteFunctionGuard(context, [self, context, argv]() {
+			SQLiteFunctionResult<typename Traits::Result>::set(context, [self, argv]() {
+				return SQLiteInvokeFunction<0>(self->func, argv,
+					typename SQLiteMakeIndices<NumArguments>::Type());
+			});
+		});
+	}
+
+	static void destroy(void * self) noexcept { delete reinterpret_cast<SQLiteScalarFunction *>(self); }
+};
+
+// Accumulator is created as a copy of `initial` on the first row of each group, updated by `stepFunc` (and
+// `inverseFunc` for window functions) and converted into the result by `finalFunc`.
+template <class ACC, class STEP, class INVERSE, class FINAL> struct SQLiteAggregateFunction
+{
+	typedef SQLiteCallableTraits<STEP> StepTraits;
+	typedef SQLiteCallableTraits<FINAL> FinalTraits;
+	enum { NumArguments = StepTraits::NumArguments - 1 };
+
+	ACC initial;
+	STEP stepFunc;
+	INVERSE inverseFunc;
+	FINAL finalFunc;
+
+	template <class S, class I, class F> SQLiteAggregateFunction(const ACC & init, S && s, I && i, F && f)
+		: initial(init),
+		  stepFunc(std::forward<S>(s)),
+		  inverseFunc(std::forward<I>(i)),
+		  finalFunc(std::forward<F>(f))
+	{
+	}
+
+	static inline SQLiteAggregateFunction * self(sqlite3_context * context) noexcept
+		{ return reinterpret_cast<SQLiteAggregateFunction *>(sqlite3_user_data(context)); }
+
+	static ACC * state(sqlite3_context * context, bool create)
+	{
+		ACC ** slot = reinterpret_cast<ACC **>(sqlite3_aggregate_context(context, create ? sizeof(ACC *) : 0));
+		if (!slot)
+		{
+			if (create)
+				throw std::bad_alloc();
+			return nullptr;
+		}
+		if (!*slot && create)
+			*slot = new ACC(self(context)->initial);
+		return *slot;
+	}
+
+	static void step(sqlite3_context * context, int, sqlite3_value ** argv) noexcept
+	{
+		SQLiteFunctionGuard(context, [context, argv]() {
+			ACC * acc = state(context, true);
+			SQLiteInvokeFunction<1>(self(context)->stepFunc, argv,
+				typename SQLiteMakeIndices<NumArguments>::Type(), *acc);
+		});
+	}
+
+	static void inverse(sqlite3_context * context, int, sqlite3_value ** argv) noexcept
+	{
+		SQLiteFunctionGuard(context, [context, argv]() {
+			ACC * acc = state(context, true);
+			SQLiteInvokeFunction<1>(self(context)->inverseFunc, argv,
+				typename SQLiteMakeIndices<NumArguments>::Type(), *acc);
+		});
+	}
+
+	static void value(sqlite3_context * context) noexcept
+	{
+		SQLiteFunctionGuard(context, [context]() {
+			ACC * acc = state(context, false);
+			SQLiteFunctionResult<typename FinalTraits::Result>::set(context, [context, acc]() {
+				return self(context)->finalFunc(acc ? *acc : self(context)->initial);
+			});
+		});
+	}
+
+	static void finalize(sqlite3_context * context) noexcept
+	{
+		value(context);
+
+		ACC ** slot = reinterpret_cast<ACC **>(sqlite3_aggregate_context(context, 0));
+		if (slot)
+		{
+			delete *slot;
+			*slot = nullptr;
+		}
+	}
+
+	static void destroy(void * self) noexcept { delete reinterpret_cast<SQLiteAggregateFunction *>(self); }
+};
+
+#endif
@@ -0,0 +1,138 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_group_commit.h"
+#include "sqlite_database.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <cstring>
+
+SQLiteGroupCommit::SQLiteGroupCommit(SQLiteDatabase & database, std::chrono::microseconds window,
+		size_t maxBatchSize)
+	: m_Database(database),
+	  m_Window(window),
+	  m_MaxBatchSize(maxBatchSize > 0 ? maxBatchSize : 1),
+	  m_HasLeader(false)
+{
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+SQLiteGroupCommit::~SQLiteGroupCommit()
+{
+}
+
+SQLiteGroupCommit::Stats SQLiteGroupCommit::stats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void SQLiteGroupCommit::transaction(const std::function<void()> & protectedCode)
+{
+	Request request;
+	request.body = &protectedCode;
+	request.done = false;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	m_Pending.push_back(&request);
+	if (m_Pending.size() >= m_MaxBatchSize)
+		m_Condition.notify_all();
+
+	while (!request.done)
+	{
+		if (m_HasLeader)
+		{
+			m_Condition.wait(lock);
+			continue;
+		}
+
+		m_HasLeader = true;
+		m_Condition.wait_for(lock, m_Window, [this]() { return m_Pending.size() >= m_MaxBatchSize; });
+
+		std::vector<Request *> group;
+		if (m_Pending.size() <= m_MaxBatchSize)
+			group.swap(m_Pending);
+		else
+		{
+			group.assign(m_Pending.begin(), m_Pending.begin() + ptrdiff_t(m_MaxBatchSize));
+			m_Pending.erase(m_Pending.begin(), m_Pending.begin() + ptrdiff_t(m_MaxBatchSize));
+		}
+
+		lock.unlock();
+		runGroup(group);
+		lock.lock();
+
+		m_HasLeader = false;
+		m_Condition.notify_all();
+	}
+
+	if (request.error)
+		std::rethrow_exception(request.error);
+}
+
+void SQLiteGroupCommit::runGroup(const std::vector<Request *> & group)
+{
+	size_t numFailed = 0;
+	bool commitFailed = false;
+
+	try
+	{
+		m_Database.transaction([this, &group, &numFailed]() {
+			for (Request * request : group)
+			{
+				try
+				{
+					m_Database.transaction(*request->body);
+				}
+				catch (...)
+				{
+					// Errors like SQLITE_FULL roll back the whole group. Later bodies would be committed one
+					// by one in autocommit mode, so the group is failed without running them.
+					if (UNLIKELY(sqlite3_get_autocommit(m_Database.handle())))
+						throw;
+
+					request->error = std::current_exception();
+					++numFailed;
+				}
+			}
+		});
+	}
+	catch (...)
+	{
+		commitFailed = true;
+		for (Request * request : group)
+			request->error = std::current_exception();
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (Request * request : group)
+		request->done = true;
+
+	++m_Stats.numGroups;
+	m_Stats.numTransactions += group.size();
+	m_Stats.numFailedTransactions += (commitFailed ? group.size() : numFailed);
+	if (commitFailed)
+		++m_Stats.numFailedCommits;
+	if (group.size() > m_Stats.maxGroupSize)
+		m_Stats.maxGroupSize = group.size();
+}
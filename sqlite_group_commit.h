@@ -0,0 +1,93 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __61327f95eedd4b5c44498c9484bfa625__
+#define __61327f95eedd4b5c44498c9484bfa625__
+
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <chrono>
+#include <vector>
+#include <mutex>
+
+class SQLiteDatabase;
+
+// Coalesces transactions submitted concurrently by multiple threads into a single physical transaction, so
+// that they share one commit (and one fsync). Each transaction body runs inside of its own savepoint: if it
+// throws, only its changes are rolled back and the exception is rethrown to its caller. If the error made
+// SQLite roll back the whole transaction (e.g. SQLITE_FULL), all bodies of the group fail with that exception.
+//
+// The first thread to submit a body becomes the leader: it waits up to `window` for other threads to join
+// (or until `maxBatchSize` bodies are pending) and then runs all bodies on its own thread. Because of that
+// bodies should not depend on the calling thread and should not submit transactions to the same group.
+class SQLiteGroupCommit
+{
+public:
+	enum { DefaultMaxBatchSize = 64 };
+
+	struct Stats
+	{
+		size_t numGroups;
+		size_t numTransactions;
+		size_t numFailedTransactions;
+		size_t numFailedCommits;
+		size_t maxGroupSize;
+	};
+
+	SQLiteGroupCommit(SQLiteDatabase & database,
+		std::chrono::microseconds window = std::chrono::microseconds(2000),
+		size_t maxBatchSize = DefaultMaxBatchSize);
+	~SQLiteGroupCommit();
+
+	inline SQLiteDatabase & database() const noexcept { return m_Database; }
+
+	Stats stats() const;
+
+	// Blocks until the group containing the body is committed. Throws the exception thrown by the body,
+	// or the error of the commit.
+	void transaction(const std::function<void()> & protectedCode);
+
+private:
+	struct Request
+	{
+		const std::function<void()> * body;
+		std::exception_ptr error;
+		bool done;
+	};
+
+	SQLiteDatabase & m_Database;
+	std::chrono::microseconds m_Window;
+	size_t m_MaxBatchSize;
+	std::vector<Request *> m_Pending;
+	mutable std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_HasLeader;
+	Stats m_Stats;
+
+	void runGroup(const std::vector<Request *> & group);
+
+	SQLiteGroupCommit(const SQLiteGroupCommit &) = delete;
+	SQLiteGroupCommit & operator=(const SQLiteGroupCommit &) = delete;
+};
+
+#endif
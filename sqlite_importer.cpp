@@ -0,0 +1,1412 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_importer.h"
+#include "sqlite_clock.h"
+#include "sqlite_database.h"
+#include "sqlite_statement.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <condition_variable>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cstdio>
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+namespace
+{
+	std::string quoteIdentifier(const std::string & name)
+	{
+		std::string result;
+		result.reserve(name.length() + 2);
+		result += '"';
+		for (char ch : name)
+		{
+			if (ch == '"')
+				result += '"';
+			result += ch;
+		}
+		result += '"';
+		return result;
+	}
+
+	// Parsed value of a single column. Text values refer to the chunk of the file they were parsed from: quotes
+	// and escape sequences are always shorter than the characters they encode, so they are decoded in place.
+	struct Value
+	{
+		enum Kind : unsigned char { Null = 0, Integer, Real, Text };
+
+		Kind kind;
+		size_t length;
+		union
+		{
+			sqlite3_int64 integer;
+			double real;
+			size_t offset;
+		};
+	};
+
+	struct Batch
+	{
+		std::vector<char> source;
+		std::vector<Value> values;          // One value per mapped column for each row
+		std::vector<size_t> lines;          // Line number of each row
+		std::vector<std::pair<size_t, std::string>> badLines;
+		uint64_t parseMicroseconds;
+	};
+
+	struct Column
+	{
+		size_t sourceIndex;
+		const std::string * key;
+		SQLiteImporter::ColumnType type;
+	};
+
+	struct Field
+	{
+		size_t offset;
+		size_t length;
+		bool quoted;
+	};
+
+	inline bool isSpace(char ch) noexcept
+	{
+		return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+	}
+
+	bool parseInteger(const char * p, const char * end, sqlite3_int64 & result) noexcept
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = (*p++ == '-');
+		if (p == end)
+			return false;
+
+		uint64_t value = 0;
+		const uint64_t limit = uint64_t(INT64_MAX) + (negative ? 1 : 0);
+		for (; p < end; ++p)
+		{
+			unsigned digit = unsigned(*p) - unsigned('0');
+			if (digit > 9 || value > (limit - digit) / 10)
+				return false;
+			value = value * 10 + digit;
+		}
+
+		result = negative ? sqlite3_int64(0 - value) : sqlite3_int64(value);
+		return true;
+	}
+
+	// Files use '.' as the decimal separator whatever the locale of the process is
+	locale_t numericLocale() noexcept
+	{
+		static locale_t locale = newlocale(LC_NUMERIC_MASK, "C", locale_t(0));
+		return locale;
+	}
+
+	bool parseReal(const char * p, const char * end, double & result)
+	{
+		if (p == end)
+			return false;
+
+		char buffer[64];
+		std::string longBuffer;
+		const char * text;
+		size_t length = size_t(end - p);
+		if (length < sizeof(buffer))
+		{
+			memcpy(buffer, p, length);
+			buffer[length] = 0;
+			text = buffer;
+		}
+		else
+		{
+			longBuffer.assign(p, length);
+			text = longBuffer.c_str();
+		}
+
+		char * parsedEnd = nullptr;
+		locale_t locale = numericLocale();
+		result = (LIKELY(locale) ? strtod_l(text, &parsedEnd, locale) : strtod(text, &parsedEnd));
+		return parsedEnd == text + length;
+	}
+
+	// Converts text to the type of the column. Numbers may be surrounded by spaces; empty numbers are NULL.
+	const char * convertText(Value & value, const char * data, size_t offset, size_t length,
+		SQLiteImporter::ColumnType type)
+	{
+		const char * p = data + offset;
+		const char * end = p + length;
+
+		switch (type)
+		{
+		case SQLiteImporter::ColumnAuto:
+		case SQLiteImporter::ColumnText:
+			value.kind = Value::Text;
+			value.offset = offset;
+			value.length = length;
+			return nullptr;
+
+		case SQLiteImporter::ColumnInteger:
+		case SQLiteImporter::ColumnReal:
+			while (p < end && isSpace(*p))
+				++p;
+			while (end > p && isSpace(end[-1]))
+				--end;
+			if (p == end)
+			{
+				value.kind = Value::Null;
+				return nullptr;
+			}
+			if (type == SQLiteImporter::ColumnInteger)
+			{
+				value.kind = Value::Integer;
+				return parseInteger(p, end, value.integer) ? nullptr : "invalid integer";
+			}
+			value.kind = Value::Real;
+			return parseReal(p, end, value.real) ? nullptr : "invalid number";
+		}
+
+		return "invalid column type";
+	}
+
+	// Parses a single CSV record (RFC 4180) starting at `pos`, unquoting fields in place. Returns an error
+	// message for malformed records, in which case `pos` is advanced to the beginning of the next line.
+	const char * parseCSVRecord(char * data, size_t & pos, size_t end, char delimiter, char quote,
+		std::vector<Field> & fields, size_t & line)
+	{
+		fields.clear();
+		for (;;)
+		{
+			Field field;
+			field.offset = pos;
+			field.quoted = (pos < end && data[pos] == quote);
+
+			if (!field.quoted)
+			{
+				while (pos < end && data[pos] != delimiter && data[pos] != '\n')
+					++pos;
+				field.length = pos - field.offset;
+				if (field.length > 0 && data[pos - 1] == '\r' && (pos == end || data[pos] == '\n'))
+					--field.length;
+			}
+			else
+			{
+				size_t out = pos++;
+				for (;;)
+				{
+					if (UNLIKELY(pos >= end))
+						return "unterminated quoted field";
+
+					char ch = data[pos++];
+					if (ch == quote)
+					{
+						if (pos >= end || data[pos] != quote)
+							break;
+						++pos;
+					}
+					else if (ch == '\n')
+						++line;
+
+					data[out++] = ch;
+				}
+				field.length = out - field.offset;
+
+				if (pos < end && data[pos] == '\r' && (pos + 1 == end || data[pos + 1] == '\n'))
+					++pos;
+				if (UNLIKELY(pos < end && data[pos] != delimiter && data[pos] != '\n'))
+				{
+					while (pos < end && data[pos] != '\n')
+						++pos;
+					if (pos < end)
+					{
+						++pos;
+						++line;
+					}
+					return "unexpected character after quoted field";
+				}
+			}
+
+			fields.push_back(field);
+
+			if (pos < end && data[pos] == delimiter)
+			{
+				++pos;
+				continue;
+			}
+
+			if (pos < end)
+			{
+				++pos;
+				++line;
+			}
+
+			return nullptr;
+		}
+	}
+
+	// Minimal in-place parser for flat JSON objects, one per line. Nested objects and arrays are kept as raw
+	// JSON text.
+	class JSONLineParser
+	{
+	public:
+		enum Kind { String, Number, True, False, Null, Nested };
+
+		JSONLineParser(char * data, char * p, char * end) noexcept : m_Data(data), m_P(p), m_End(end) {}
+
+		const char * error() const noexcept { return m_Error; }
+
+		inline void skipSpace() noexcept
+		{
+			while (m_P < m_End && isSpace(*m_P))
+				++m_P;
+		}
+
+		inline bool atEnd() noexcept { skipSpace(); return m_P == m_End; }
+
+		inline bool expect(char ch) noexcept
+		{
+			skipSpace();
+			if (m_P < m_End && *m_P == ch)
+			{
+				++m_P;
+				return true;
+			}
+			return false;
+		}
+
+		inline bool peek(char ch) noexcept { skipSpace(); return m_P < m_End && *m_P == ch; }
+
+		bool parseString(size_t & offset, size_t & length) noexcept
+		{
+			skipSpace();
+			if (m_P >= m_End || *m_P != '"')
+				return fail("expected string");
+
+			char * out = ++m_P;
+			offset = size_t(out - m_Data);
+			for (;;)
+			{
+				if (UNLIKELY(m_P >= m_End))
+					return fail("unterminated string");
+
+				char ch = *m_P++;
+				if (ch == '"')
+					break;
+				else if (UNLIKELY((unsigned char)ch < 0x20))
+					return fail("control character in string");
+				else if (ch != '\\')
+					*out++ = ch;
+				else
+				{
+					if (UNLIKELY(m_P >= m_End))
+						return fail("unterminated string");
+					switch (*m_P++)
+					{
+					case '"': *out++ = '"'; break;
+					case '\\': *out++ = '\\'; break;
+					case '/': *out++ = '/'; break;
+					case 'b': *out++ = '\b'; break;
+					case 'f': *out++ = '\f'; break;
+					case 'n': *out++ = '\n'; break;
+					case 'r': *out++ = '\r'; break;
+					case 't': *out++ = '\t'; break;
+					case 'u':
+						if (!parseUnicodeEscape(out))
+							return false;
+						break;
+					default:
+						return fail("invalid escape sequence");
+					}
+				}
+			}
+
+			length = size_t(out - m_Data) - offset;
+			return true;
+		}
+
+		// Parses any value; for strings `offset` and `length` refer to the decoded text, for other values to the
+		// raw JSON text. `isInteger` is set for numbers without fraction and exponent.
+		bool parseValue(Kind & kind, size_t & offset, size_t & length, bool & isInteger) noexcept
+		{
+			skipSpace();
+			if (UNLIKELY(m_P >= m_End))
+				return fail("expected value");
+
+			char * start = m_P;
+			switch (*m_P)
+			{
+			case '"':
+				kind = String;
+				return parseString(offset, length);
+
+			case '{':
+			case '[':
+				kind = Nested;
+				if (!skipNested())
+					return false;
+				break;
+
+			case 't':
+				kind = True;
+				if (!literal("true"))
+					return false;
+				break;
+
+			case 'f':
+				kind = False;
+				if (!literal("false"))
+					return false;
+				break;
+
+			case 'n':
+				kind = Null;
+				if (!literal("null"))
+					return false;
+				break;
+
+			default:
+				kind = Number;
+				if (!parseNumber(isInteger))
+					return false;
+				break;
+			}
+
+			offset = size_t(start - m_Data);
+			length = size_t(m_P - start);
+			return true;
+		}
+
+	private:
+		char * m_Data;
+		char * m_P;
+		char * m_End;
+		const char * m_Error = nullptr;
+
+		inline bool fail(const char * message) noexcept
+		{
+			m_Error = message;
+			return false;
+		}
+
+		bool literal(const char * text) noexcept
+		{
+			size_t length = strlen(text);
+			if (size_t(m_End - m_P) < length || memcmp(m_P, text, length) != 0)
+				return fail("invalid value");
+			m_P += length;
+			return true;
+		}
+
+		bool parseNumber(bool & isInteger) noexcept
+		{
+			isInteger = true;
+			if (m_P < m_End && *m_P == '-')
+				++m_P;
+
+			char * digits = m_P;
+			while (m_P < m_End && unsigned(*m_P) - unsigned('0') <= 9)
+				++m_P;
+			if (UNLIKELY(m_P == digits))
+				return fail("invalid value");
+
+			if (m_P < m_End && *m_P == '.')
+			{
+				isInteger = false;
+				digits = ++m_P;
+				while (m_P < m_End && unsigned(*m_P) - unsigned('0') <= 9)
+					++m_P;
+				if (UNLIKELY(m_P == digits))
+					return fail("invalid number");
+			}
+
+			if (m_P < m_End && (*m_P == 'e' || *m_P == 'E'))
+			{
+				isInteger = false;
+				if (++m_P < m_End && (*m_P == '+' || *m_P == '-'))
+					++m_P;
+				digits = m_P;
+				while (m_P < m_End && unsigned(*m_P) - unsigned('0') <= 9)
+					++m_P;
+				if (UNLIKELY(m_P == digits))
+					return fail("invalid number");
+			}
+
+			return true;
+		}
+
+		bool skipNested() noexcept
+		{
+			size_t depth = 0;
+			bool inString = false;
+			while (m_P < m_End)
+			{
+				char ch = *m_P++;
+				if (inString)
+				{
+					if (ch == '\\' && m_P < m_End)
+						++m_P;
+					else if (ch == '"')
+						inString = false;
+				}
+				else if (ch == '"')
+					inString = true;
+				else if (ch == '{' || ch == '[')
+					++depth;
+				else if ((ch == '}' || ch == ']') && --depth == 0)
+					return true;
+			}
+			return fail("unterminated object or array");
+		}
+
+		bool parseHex4(unsigned & code) noexcept
+		{
+			if (UNLIKELY(m_End - m_P < 4))
+				return fail("invalid unicode escape");
+
+			code = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				char ch = *m_P++;
+				code <<= 4;
+				if (ch >= '0' && ch <= '9')
+					code |= unsigned(ch - '0');
+				else if (ch >= 'a' && ch <= 'f')
+					code |= unsigned(ch - 'a' + 10);
+				else if (ch >= 'A' && ch <= 'F')
+					code |= unsigned(ch - 'A' + 10);
+				else
+					return fail("invalid unicode escape");
+			}
+
+			return true;
+		}
+
+		bool parseUnicodeEscape(char *& out) noexcept
+		{
+			unsigned code;
+			if (!parseHex4(code))
+				return false;
+
+			if (code >= 0xD800 && code <= 0xDBFF)
+			{
+				unsigned low;
+				if (m_End - m_P < 2 || m_P[0] != '\\' || m_P[1] != 'u')
+					return fail("invalid surrogate pair");
+				m_P += 2;
+				if (!parseHex4(low))
+					return false;
+				if (low < 0xDC00 || low > 0xDFFF)
+					return fail("invalid surrogate pair");
+				code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+			}
+			else if (code >= 0xDC00 && code <= 0xDFFF)
+				return fail("invalid surrogate pair");
+
+			if (code < 0x80)
+				*out++ = char(code);
+			else if (code < 0x800)
+			{
+				*out++ = char(0xC0 | (code >> 6));
+				*out++ = char(0x80 | (code & 0x3F));
+			}
+			else if (code < 0x10000)
+			{
+				*out++ = char(0xE0 | (code >> 12));
+				*out++ = char(0x80 | ((code >> 6) & 0x3F));
+				*out++ = char(0x80 | (code & 0x3F));
+			}
+			else
+			{
+				*out++ = char(0xF0 | (code >> 18));
+				*out++ = char(0x80 | ((code >> 12) & 0x3F));
+				*out++ = char(0x80 | ((code >> 6) & 0x3F));
+				*out++ = char(0x80 | (code & 0x3F));
+			}
+
+			return true;
+		}
+	};
+
+	const char * convertJSON(Value & value, const char * data, JSONLineParser::Kind kind, size_t offset,
+		size_t length, bool isInteger, SQLiteImporter::ColumnType type)
+	{
+		switch (kind)
+		{
+		case JSONLineParser::Null:
+			value.kind = Value::Null;
+			return nullptr;
+
+		case JSONLineParser::String:
+			return convertText(value, data, offset, length, type);
+
+		case JSONLineParser::True:
+		case JSONLineParser::False:
+			if (type == SQLiteImporter::ColumnText)
+				return convertText(value, data, offset, length, type);
+			if (type == SQLiteImporter::ColumnReal)
+			{
+				value.kind = Value::Real;
+				value.real = (kind == JSONLineParser::True ? 1.0 : 0.0);
+				return nullptr;
+			}
+			value.kind = Value::Integer;
+			value.integer = (kind == JSONLineParser::True ? 1 : 0);
+			return nullptr;
+
+		case JSONLineParser::Number:
+			if (type == SQLiteImporter::ColumnText)
+				return convertText(value, data, offset, length, type);
+			if (type != SQLiteImporter::ColumnReal && isInteger)
+			{
+				value.kind = Value::Integer;
+				if (parseInteger(data + offset, data + offset + length, value.integer))
+					return nullptr;
+			}
+			value.kind = Value::Real;
+			if (!parseReal(data + offset, data + offset + length, value.real))
+				return "invalid number";
+			if (type == SQLiteImporter::ColumnInteger)
+			{
+				if (value.real < -9223372036854775808.0 || value.real >= 9223372036854775808.0
+						|| double(sqlite3_int64(value.real)) != value.real)
+					return "invalid integer";
+				value.kind = Value::Integer;
+				value.integer = sqlite3_int64(value.real);
+			}
+			return nullptr;
+
+		case JSONLineParser::Nested:
+			if (type == SQLiteImporter::ColumnInteger || type == SQLiteImporter::ColumnReal)
+				return "expected number";
+			return convertText(value, data, offset, length, SQLiteImporter::ColumnText);
+		}
+
+		return "invalid value";
+	}
+
+	// Reads the file in large chunks, each ending at a record boundary.
+	class ChunkReader
+	{
+	public:
+		ChunkReader(FILE * file, size_t chunkBytes, int quote) noexcept
+			: m_File(file),
+			  m_ChunkBytes(chunkBytes),
+			  m_Scanned(0),
+			  m_Break(0),
+			  m_NextLine(1),
+			  m_BytesRead(0),
+			  m_Quote(quote),
+			  m_InQuotes(false),
+			  m_EndOfFile(false),
+			  m_Started(false)
+		{
+		}
+
+		inline uint64_t bytesRead() const noexcept { return m_BytesRead; }
+
+		// Returns false at the end of file. When `singleRecord` is set, returns just the next record.
+		bool next(std::vector<char> & chunk, size_t & firstLine, bool singleRecord = false)
+		{
+			for (;;)
+			{
+				scan(singleRecord);
+				if (m_Break > 0 && (singleRecord || m_EndOfFile || m_Pending.size() >= m_ChunkBytes))
+					break;
+
+				if (m_EndOfFile)
+				{
+					if (m_Pending.empty())
+						return false;
+					m_Break = m_Pending.size();
+					m_Scanned = m_Break;
+					break;
+				}
+
+				read();
+			}
+
+			chunk.assign(m_Pending.begin(), m_Pending.begin() + ptrdiff_t(m_Break));
+			m_Pending.erase(m_Pending.begin(), m_Pending.begin() + ptrdiff_t(m_Break));
+			m_Scanned -= m_Break;
+			m_Break = 0;
+
+			firstLine = m_NextLine;
+			m_NextLine += size_t(std::count(chunk.begin(), chunk.end(), '\n'));
+
+			return true;
+		}
+
+	private:
+		FILE * m_File;
+		std::vector<char> m_Pending;
+		size_t m_ChunkBytes;
+		size_t m_Scanned;
+		size_t m_Break;             // End of the last complete record in m_Pending, or zero
+		size_t m_NextLine;
+		uint64_t m_BytesRead;
+		int m_Quote;                // Negative if newlines are never quoted
+		bool m_InQuotes;
+		bool m_EndOfFile;
+		bool m_Started;
+
+		void scan(bool stopAtFirst) noexcept
+		{
+			const char * data = m_Pending.data();
+			size_t size = m_Pending.size();
+
+			if (m_Quote < 0 && !stopAtFirst)
+			{
+				for (size_t i = size; i > m_Scanned; --i)
+				{
+					if (data[i - 1] == '\n')
+					{
+						m_Break = i;
+						break;
+					}
+				}
+				m_Scanned = size;
+				return;
+			}
+
+			const char quote = char(m_Quote);
+			for (size_t i = m_Scanned; i < size; ++i)
+			{
+				char ch = data[i];
+				if (ch == quote && m_Quote >= 0)
+					m_InQuotes = !m_InQuotes;
+				else if (ch == '\n' && !m_InQuotes)
+				{
+					m_Break = i + 1;
+					if (stopAtFirst)
+					{
+						m_Scanned = m_Break;
+						return;
+					}
+				}
+			}
+			m_Scanned = size;
+		}
+
+		void read()
+		{
+			size_t oldSize = m_Pending.size();
+			m_Pending.resize(oldSize + m_ChunkBytes);
+
+			size_t bytesRead = fread(m_Pending.data() + oldSize, 1, m_ChunkBytes, m_File);
+			m_Pending.resize(oldSize + bytesRead);
+			m_BytesRead += bytesRead;
+
+			if (bytesRead < m_ChunkBytes)
+			{
+				if (UNLIKELY(ferror(m_File)))
+					throw std::runtime_error(fmt() << "unable to read file: " << strerror(errno));
+				m_EndOfFile = true;
+			}
+
+			if (!m_Started)
+			{
+				static const char bom[] = "\xEF\xBB\xBF";
+				if (m_Pending.size() >= 3 && memcmp(m_Pending.data(), bom, 3) == 0)
+					m_Pending.erase(m_Pending.begin(), m_Pending.begin() + 3);
+				m_Started = true;
+			}
+		}
+	};
+
+	// Extended result codes (SQLITE_OPEN_EXRESCODE) are reduced to their primary codes
+	inline bool isRowError(int err) noexcept
+	{
+		err &= 0xff;
+		return err == SQLITE_CONSTRAINT || err == SQLITE_MISMATCH || err == SQLITE_TOOBIG;
+	}
+}
+
+// Reader thread splits the file into chunks, parser threads turn chunks into batches of typed values, and the
+// calling thread inserts batches in the order of chunks. At most `maxQueuedChunks` chunks are in flight, so
+// the reader waits for the writer when parsing or inserting falls behind.
+class SQLiteImporter::Pipeline
+{
+public:
+	Pipeline(SQLiteImporter & importer, ChunkReader & reader, const std::vector<Column> & columns, Stats & stats,
+			SQLiteClock::time_point startTime)
+		: m_Importer(importer),
+		  m_Options(importer.m_Options),
+		  m_Reader(reader),
+		  m_Columns(columns),
+		  m_Stats(stats),
+		  m_StartTime(startTime),
+		  m_MaxQueuedChunks(m_Options.maxQueuedChunks),
+		  m_NumChunks(0),
+		  m_NextWrite(0),
+		  m_ReaderDone(false),
+		  m_Stop(false)
+	{
+	}
+
+	~Pipeline()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_ChunkQueued.notify_all();
+		m_SlotFree.notify_all();
+		for (std::thread & thread : m_Threads)
+			thread.join();
+	}
+
+	void run(SQLiteStatement & insert)
+	{
+		size_t numThreads = m_Options.numThreads;
+		if (numThreads == 0)
+		{
+			unsigned numCPUs = std::thread::hardware_concurrency();
+			numThreads = (numCPUs > 1 ? numCPUs - 1 : 1);
+		}
+		if (m_MaxQueuedChunks == 0)
+			m_MaxQueuedChunks = 2 * numThreads + 2;
+
+		m_Threads.reserve(numThreads + 1);
+		m_Threads.emplace_back(&Pipeline::readerThread, this);
+		for (size_t i = 0; i < numThreads; i++)
+			m_Threads.emplace_back(&Pipeline::parserThread, this);
+
+		// The database is locked during the transaction, so parsers are waited for outside of it: if the next
+		// batch is not ready yet, the transaction is committed before reaching `commitSize` rows.
+		std::unique_ptr<Batch> batch;
+		while (nextBatch(batch, true))
+		{
+			m_Importer.m_Database.transaction([this, &insert, &batch]() {
+				size_t numRows = write(insert, *batch);
+				while (numRows < m_Options.commitSize && nextBatch(batch, false))
+					numRows += write(insert, *batch);
+			}, SQLiteDatabase::ImmediateTransaction);
+		}
+	}
+
+private:
+	struct Chunk
+	{
+		size_t sequence;
+		size_t firstLine;
+		std::vector<char> data;
+	};
+
+	SQLiteImporter & m_Importer;
+	const Options & m_Options;
+	ChunkReader & m_Reader;
+	const std::vector<Column> & m_Columns;
+	Stats & m_Stats;
+	SQLiteClock::time_point m_StartTime;
+	size_t m_MaxQueuedChunks;
+	std::mutex m_Mutex;
+	std::condition_variable m_ChunkQueued;
+	std::condition_variable m_BatchParsed;
+	std::condition_variable m_SlotFree;
+	std::deque<Chunk> m_Chunks;
+	std::map<size_t, std::unique_ptr<Batch>> m_Batches;
+	std::vector<std::thread> m_Threads;
+	std::exception_ptr m_Error;
+	size_t m_NumChunks;
+	size_t m_NextWrite;
+	bool m_ReaderDone;
+	bool m_Stop;
+
+	void fail(std::exception_ptr error) noexcept
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!m_Error)
+				m_Error = error;
+			m_Stop = true;
+		}
+		m_ChunkQueued.notify_all();
+		m_BatchParsed.notify_all();
+		m_SlotFree.notify_all();
+	}
+
+	void readerThread() noexcept
+	{
+		try
+		{
+			for (;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(m_Mutex);
+					m_SlotFree.wait(lock, [this]() {
+						return m_Stop || m_NumChunks < m_NextWrite + m_MaxQueuedChunks;
+					});
+					if (m_Stop)
+						return;
+				}
+
+				Chunk chunk;
+				if (!m_Reader.next(chunk.data, chunk.firstLine))
+					break;
+
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				chunk.sequence = m_NumChunks++;
+				m_Chunks.push_back(std::move(chunk));
+				m_ChunkQueued.notify_one();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_ReaderDone = true;
+			}
+			m_ChunkQueued.notify_all();
+			m_BatchParsed.notify_all();
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+		}
+	}
+
+	void parserThread() noexcept
+	{
+		try
+		{
+			std::vector<Field> fields;
+			for (;;)
+			{
+				Chunk chunk;
+				{
+					std::unique_lock<std::mutex> lock(m_Mutex);
+					m_ChunkQueued.wait(lock, [this]() { return m_Stop || m_ReaderDone || !m_Chunks.empty(); });
+					if (m_Stop || m_Chunks.empty())
+						return;
+					chunk = std::move(m_Chunks.front());
+					m_Chunks.pop_front();
+				}
+
+				SQLiteClock::time_point startTime = SQLiteClock::now();
+				std::unique_ptr<Batch> batch(new Batch);
+				batch->source.swap(chunk.data);
+				if (m_Options.format == NDJSON)
+					parseNDJSON(*batch, chunk.firstLine);
+				else
+					parseCSV(*batch, chunk.firstLine, fields);
+				batch->parseMicroseconds = SQLiteMicrosecondsSince(startTime);
+
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Batches[chunk.sequence] = std::move(batch);
+				m_BatchParsed.notify_all();
+			}
+		}
+		catch (...)
+		{
+			fail(std::current_exception());
+		}
+	}
+
+	void parseCSV(Batch & batch, size_t line, std::vector<Field> & fields)
+	{
+		char * data = batch.source.data();
+		const size_t end = batch.source.size();
+		const size_t numColumns = m_Columns.size();
+		const char delimiter = m_Options.delimiter;
+		const char quote = m_Options.quote;
+
+		size_t pos = 0;
+		while (pos < end)
+		{
+			size_t recordLine = line;
+			const char * error = parseCSVRecord(data, pos, end, delimiter, quote, fields, line);
+			if (UNLIKELY(error))
+			{
+				batch.badLines.emplace_back(recordLine, error);
+				continue;
+			}
+
+			if (fields.size() == 1 && fields[0].length == 0 && !fields[0].quoted)
+				continue;
+
+			size_t row = batch.values.size();
+			batch.values.resize(row + numColumns);
+			Value * values = &batch.values[row];
+			for (size_t i = 0; i < numColumns; i++)
+			{
+				const Column & column = m_Columns[i];
+				if (UNLIKELY(column.sourceIndex >= fields.size()))
+				{
+					error = "missing field";
+					break;
+				}
+
+				const Field & field = fields[column.sourceIndex];
+				if (field.length == 0 && !field.quoted && m_Options.emptyAsNull)
+					values[i].kind = Value::Null;
+				else
+				{
+					error = convertText(values[i], data, field.offset, field.length, column.type);
+					if (UNLIKELY(error))
+						break;
+				}
+			}
+
+			if (LIKELY(!error))
+				batch.lines.push_back(recordLine);
+			else
+			{
+				batch.values.resize(row);
+				batch.badLines.emplace_back(recordLine, error);
+			}
+		}
+	}
+
+	void parseNDJSON(Batch & batch, size_t line)
+	{
+		char * data = batch.source.data();
+		char * end = data + batch.source.size();
+		const size_t numColumns = m_Columns.size();
+
+		for (char * p = data; p < end; ++line)
+		{
+			char * lineEnd = static_cast<char *>(memchr(p, '\n', size_t(end - p)));
+			if (!lineEnd)
+				lineEnd = end;
+
+			JSONLineParser parser(data, p, lineEnd);
+			p = lineEnd + (lineEnd < end ? 1 : 0);
+			if (parser.atEnd())
+				continue;
+
+			size_t row = batch.values.size();
+			batch.values.resize(row + numColumns);
+			Value * values = &batch.values[row];
+			for (size_t i = 0; i < numColumns; i++)
+				values[i].kind = Value::Null;
+
+			const char * error = parseJSONObject(parser, data, values);
+			if (LIKELY(!error))
+				batch.lines.push_back(line);
+			else
+			{
+				batch.values.resize(row);
+				batch.badLines.emplace_back(line, error);
+			}
+		}
+	}
+
+	const char * parseJSONObject(JSONLineParser & parser, const char * data, Value * values)
+	{
+		if (!parser.expect('{'))
+			return "expected JSON object";
+
+		if (!parser.expect('}'))
+		{
+			do {
+				size_t keyOffset, keyLength, offset, length;
+				JSONLineParser::Kind kind;
+				bool isInteger = false;
+
+				if (!parser.parseString(keyOffset, keyLength))
+					return parser.error();
+				if (!parser.expect(':'))
+					return "expected ':'";
+				if (!parser.parseValue(kind, offset, length, isInteger))
+					return parser.error();
+
+				for (size_t i = 0; i < m_Columns.size(); i++)
+				{
+					const std::string & key = *m_Columns[i].key;
+					if (key.length() == keyLength && memcmp(key.data(), data + keyOffset, keyLength) == 0)
+					{
+						const char * error = convertJSON(values[i], data, kind, offset, length, isInteger,
+							m_Columns[i].type);
+						if (UNLIKELY(error))
+							return error;
+					}
+				}
+			} while (parser.expect(','));
+
+			if (!parser.expect('}'))
+				return "expected ',' or '}'";
+		}
+
+		if (!parser.atEnd())
+			return "unexpected data after JSON object";
+
+		return nullptr;
+	}
+
+	// Returns false at the end of the input or, if `wait` is false, when the next batch is not parsed yet.
+	bool nextBatch(std::unique_ptr<Batch> & batch, bool wait)
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		for (;;)
+		{
+			if (UNLIKELY(m_Error))
+				std::rethrow_exception(m_Error);
+
+			auto it = m_Batches.find(m_NextWrite);
+			if (it != m_Batches.end())
+			{
+				batch = std::move(it->second);
+				m_Batches.erase(it);
+				++m_NextWrite;
+				m_SlotFree.notify_one();
+				return true;
+			}
+
+			if (!wait || (m_ReaderDone && m_NextWrite == m_NumChunks))
+				return false;
+
+			SQLiteClock::time_point startTime = SQLiteClock::now();
+			m_BatchParsed.wait(lock);
+			m_Stats.writerWaitMicroseconds += SQLiteMicrosecondsSince(startTime);
+		}
+	}
+
+	size_t write(SQLiteStatement & insert, const Batch & batch)
+	{
+		const char * data = batch.source.data();
+		const size_t numColumns = m_Columns.size();
+		const size_t numRows = batch.lines.size();
+
+		for (const auto & badLine : batch.badLines)
+		{
+			++m_Stats.badLines;
+			if (m_Importer.m_OnBadLine)
+				m_Importer.m_OnBadLine(badLine.first, badLine.second);
+		}
+
+		const Value * value = batch.values.data();
+		for (size_t row = 0; row < numRows; row++)
+		{
+			try
+			{
+				for (size_t i = 0; i < numColumns; i++, value++)
+				{
+					int index = int(i + 1);
+					switch (value->kind)
+					{
+					case Value::Null: insert.bindNull(index); break;
+					case Value::Integer: insert.bindInt64(index, value->integer); break;
+					case Value::Real: insert.bindDouble(index, value->real); break;
+					case Value::Text: insert.bindStaticText(index, data + value->offset, value->length); break;
+					}
+				}
+
+				insert.exec();
+				++m_Stats.rowsImported;
+			}
+			catch (const std::runtime_error & e)
+			{
+				if (!isRowError(sqlite3_errcode(m_Importer.m_Database.handle())))
+					throw;
+
+				value = batch.values.data() + (row + 1) * numColumns;
+				++m_Stats.rejectedRows;
+				if (m_Importer.m_OnBadLine)
+					m_Importer.m_OnBadLine(batch.lines[row], e.what());
+			}
+		}
+
+		// Text values are bound without copying and are about to be freed
+		insert.clearBindings();
+
+		++m_Stats.chunks;
+		m_Stats.bytesRead += batch.source.size();
+		m_Stats.parseMicroseconds += batch.parseMicroseconds;
+		if (m_Importer.m_OnProgress)
+		{
+			m_Stats.microseconds = SQLiteMicrosecondsSince(m_StartTime);
+			m_Importer.m_OnProgress(m_Stats);
+		}
+
+		return numRows;
+	}
+};
+
+namespace
+{
+	struct Index
+	{
+		std::string name;
+		std::string sql;
+	};
+
+	// Drops indexes created with CREATE INDEX. Unique indexes are kept so that they are still enforced.
+	std::vector<Index> dropIndexes(SQLiteDatabase & database, const std::string & table)
+	{
+		std::vector<Index> indexes;
+		std::string sql = "PRAGMA index_list(" + quoteIdentifier(table) + ")";
+		database.exec(sql, [&indexes](const SQLiteCursor & cursor) {
+			if (cursor.toInt(2) == 0 && strcmp(cursor.toText(3), "c") == 0)
+			{
+				Index index;
+				index.name = cursor.toString(1);
+				indexes.push_back(index);
+			}
+		});
+
+		if (indexes.empty())
+			return indexes;
+
+		SQLiteStatement select(database, "SELECT sql FROM sqlite_master WHERE type = 'index' AND name = ?");
+		for (Index & index : indexes)
+		{
+			select.bindString(1, index.name);
+			select.exec([&index](const SQLiteCursor & cursor) { index.sql = cursor.toString(0); });
+		}
+
+		database.transaction([&database, &indexes]() {
+			for (const Index & index : indexes)
+				database.exec("DROP INDEX " + quoteIdentifier(index.name));
+		});
+
+		return indexes;
+	}
+
+	void createIndexes(SQLiteDatabase & database, const std::vector<Index> & indexes)
+	{
+		database.transaction([&database, &indexes]() {
+			for (const Index & index : indexes)
+				database.exec(index.sql);
+		});
+	}
+}
+
+SQLiteImporter::Options::Options() noexcept
+	: format(CSV),
+	  delimiter(','),
+	  quote('"'),
+	  hasHeader(true),
+	  emptyAsNull(false),
+	  rebuildIndexes(false),
+	  numThreads(0),
+	  chunkBytes(DefaultChunkBytes),
+	  commitSize(DefaultCommitSize),
+	  maxQueuedChunks(0)
+{
+}
+
+SQLiteImporter::SQLiteImporter(SQLiteDatabase & database, const std::string & table, const Options & options)
+	: m_Database(database),
+	  m_Table(table),
+	  m_Options(options)
+{
+	if (m_Options.chunkBytes == 0)
+		m_Options.chunkBytes = DefaultChunkBytes;
+	if (m_Options.commitSize == 0)
+		m_Options.commitSize = DefaultCommitSize;
+}
+
+SQLiteImporter::~SQLiteImporter()
+{
+}
+
+SQLiteImporter & SQLiteImporter::map(const std::string & source, const std::string & column, ColumnType type)
+{
+	Mapping mapping;
+	mapping.source = source;
+	mapping.sourceIndex = std::string::npos;
+	mapping.column = column;
+	mapping.type = type;
+	m_Mappings.push_back(mapping);
+	return *this;
+}
+
+SQLiteImporter & SQLiteImporter::map(size_t sourceIndex, const std::string & column, ColumnType type)
+{
+	Mapping mapping;
+	mapping.sourceIndex = sourceIndex;
+	mapping.column = column;
+	mapping.type = type;
+	m_Mappings.push_back(mapping);
+	return *this;
+}
+
+SQLiteImporter::Stats SQLiteImporter::importFile(const std::string & path)
+{
+	SQLiteClock::time_point startTime = SQLiteClock::now();
+
+	Stats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	std::unique_ptr<FILE, int(*)(FILE *)> file(fopen(path.c_str(), "rb"), fclose);
+	if (UNLIKELY(!file))
+		throw std::runtime_error(fmt() << "unable to open file \"" << path << "\": " << strerror(errno));
+
+	ChunkReader reader(file.get(), m_Options.chunkBytes, m_Options.format == CSV ? int(m_Options.quote) : -1);
+
+	std::vector<std::string> header;
+	if (m_Options.format == CSV && m_Options.hasHeader)
+	{
+		std::vector<char> chunk;
+		size_t line = 1;
+		if (reader.next(chunk, line, true))
+		{
+			std::vector<Field> fields;
+			size_t pos = 0;
+			const char * error = parseCSVRecord(chunk.data(), pos, chunk.size(), m_Options.delimiter,
+				m_Options.quote, fields, line);
+			if (UNLIKELY(error))
+				throw std::runtime_error(fmt() << "invalid header in file \"" << path << "\": " << error);
+			for (const Field & field : fields)
+				header.push_back(std::string(chunk.data() + field.offset, field.length));
+		}
+		stats.bytesRead += chunk.size();
+	}
+
+	std::vector<Mapping> mappings = m_Mappings;
+	if (mappings.empty())
+	{
+		auto addMapping = [&mappings](const std::string & source, size_t sourceIndex, const std::string & column) {
+			Mapping mapping;
+			mapping.source = source;
+			mapping.sourceIndex = sourceIndex;
+			mapping.column = column;
+			mapping.type = ColumnAuto;
+			mappings.push_back(mapping);
+		};
+
+		std::vector<std::string> columns = tableColumns();
+		if (m_Options.format == NDJSON)
+		{
+			for (const std::string & column : columns)
+				addMapping(column, std::string::npos, column);
+		}
+		else if (!m_Options.hasHeader)
+		{
+			for (size_t i = 0; i < columns.size(); i++)
+				addMapping(std::string(), i, columns[i]);
+		}
+		else
+		{
+			for (const std::string & name : header)
+			{
+				auto it = std::find_if(columns.begin(), columns.end(), [&name](const std::string & column) {
+					return sqlite3_stricmp(name.c_str(), column.c_str()) == 0;
+				});
+				if (it != columns.end())
+					addMapping(name, std::string::npos, *it);
+			}
+		}
+	}
+
+	if (UNLIKELY(mappings.empty()))
+		throw std::runtime_error(fmt() << "no columns of file \"" << path << "\" match columns of table \""
+			<< m_Table << "\".");
+
+	std::vector<Column> columns;
+	columns.reserve(mappings.size());
+	for (Mapping & mapping : mappings)
+	{
+		if (m_Options.format == NDJSON)
+		{
+			if (UNLIKELY(mapping.sourceIndex != std::string::npos))
+				throw std::runtime_error("NDJSON columns should be mapped by key.");
+		}
+		else if (mapping.sourceIndex == std::string::npos)
+		{
+			if (UNLIKELY(!m_Options.hasHeader))
+				throw std::runtime_error("CSV columns should be mapped by index when file has no header.");
+
+			auto it = std::find(header.begin(), header.end(), mapping.source);
+			if (UNLIKELY(it == header.end()))
+				throw std::runtime_error(fmt() << "column \"" << mapping.source << "\" not found in file \""
+					<< path << "\".");
+			mapping.sourceIndex = size_t(it - header.begin());
+		}
+
+		Column column;
+		column.sourceIndex = mapping.sourceIndex;
+		column.key = &mapping.source;
+		column.type = mapping.type;
+		columns.push_back(column);
+	}
+
+	SQLiteStatement insert(m_Database, insertStatement(mappings));
+
+	std::vector<Index> indexes;
+	if (m_Options.rebuildIndexes)
+		indexes = dropIndexes(m_Database, m_Table);
+
+	try
+	{
+		Pipeline pipeline(*this, reader, columns, stats, startTime);
+		pipeline.run(insert);
+	}
+	catch (...)
+	{
+		if (!indexes.empty())
+		{
+			try {
+				createIndexes(m_Database, indexes);
+			} catch (...) {
+			}
+		}
+		throw;
+	}
+
+	if (!indexes.empty())
+		createIndexes(m_Database, indexes);
+
+	stats.microseconds = SQLiteMicrosecondsSince(startTime);
+	return stats;
+}
+
+std::vector<std::string> SQLiteImporter::tableColumns()
+{
+	std::vector<std::string> columns;
+	std::string sql = "PRAGMA table_info(" + quoteIdentifier(m_Table) + ")";
+	m_Database.exec(sql, [&columns](const SQLiteCursor & cursor) {
+		columns.push_back(cursor.toString(1));
+	});
+
+	if (UNLIKELY(columns.empty()))
+		throw std::runtime_error(fmt() << "table \"" << m_Table << "\" does not exist.");
+
+	return columns;
+}
+
+std::string SQLiteImporter::insertStatement(const std::vector<Mapping> & mappings) const
+{
+	std::string sql = "INSERT INTO " + quoteIdentifier(m_Table) + " (";
+	for (size_t i = 0; i < mappings.size(); i++)
+	{
+		if (i > 0)
+			sql += ", ";
+		sql += quoteIdentifier(mappings[i].column);
+	}
+	sql += ") VALUES (";
+	for (size_t i = 0; i < mappings.size(); i++)
+		sql += (i > 0 ? ", ?" : "?");
+	sql += ')';
+	return sql;
+}
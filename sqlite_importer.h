@@ -0,0 +1,143 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __4b086dc6f1c5434c73cafc0d7caf5162__
+#define __4b086dc6f1c5434c73cafc0d7caf5162__
+
+#include <functional>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SQLiteDatabase;
+
+// Bulk import of CSV and NDJSON files into a table. The file is read in large chunks split at line boundaries,
+// chunks are parsed into typed row batches by worker threads, and rows are inserted in file order by the
+// calling thread with a cached INSERT statement inside of large transactions.
+class SQLiteImporter
+{
+public:
+	enum Format
+	{
+		CSV = 0,
+		NDJSON,
+	};
+
+	// Auto binds CSV fields and JSON strings as text and JSON numbers as numbers, leaving conversions to the
+	// affinity of the table column. Empty CSV fields are bound as NULL for integer and real columns.
+	enum ColumnType
+	{
+		ColumnAuto = 0,
+		ColumnInteger,
+		ColumnReal,
+		ColumnText,
+	};
+
+	enum
+	{
+		DefaultChunkBytes = 4 * 1024 * 1024,
+		DefaultCommitSize = 100000,
+	};
+
+	struct Options
+	{
+		Format format;
+		char delimiter;
+		char quote;
+		bool hasHeader;             // CSV only
+		bool emptyAsNull;           // Bind empty CSV fields as NULL for all columns
+		bool rebuildIndexes;        // Drop secondary indexes of the table before the load and recreate them after
+		size_t numThreads;          // Number of parser threads; zero means number of CPUs minus one
+		size_t chunkBytes;
+		size_t commitSize;          // Maximum rows per transaction
+		size_t maxQueuedChunks;     // Limits memory used by chunks in flight; zero means twice the threads
+
+		Options() noexcept;
+	};
+
+	struct Stats
+	{
+		size_t rowsImported;
+		size_t badLines;            // Lines that could not be parsed or converted
+		size_t rejectedRows;        // Rows rejected by the database (constraint violations, etc.)
+		size_t chunks;
+		uint64_t bytesRead;
+		uint64_t microseconds;
+		uint64_t parseMicroseconds;         // Summed over all parser threads
+		uint64_t writerWaitMicroseconds;    // Time the writer was waiting for parsed rows
+
+		inline double rowsPerSecond() const noexcept
+			{ return microseconds > 0 ? double(rowsImported) * 1000000.0 / double(microseconds) : 0.0; }
+		inline double megabytesPerSecond() const noexcept
+			{ return microseconds > 0 ? double(bytesRead) / double(microseconds) : 0.0; }
+	};
+
+	// Called on the calling thread for lines that could not be parsed and for rows rejected by the database;
+	// `line` is one-based.
+	typedef std::function<void(size_t line, const std::string & error)> BadLineCallback;
+	typedef std::function<void(const Stats & stats)> ProgressCallback;
+
+	SQLiteImporter(SQLiteDatabase & database, const std::string & table, const Options & options = Options());
+	~SQLiteImporter();
+
+	// Maps CSV column with the given header name, or NDJSON key, to the column of the table. Without any
+	// mappings CSV columns and NDJSON keys are mapped to table columns of the same name (CSV columns are mapped
+	// in order if there is no header).
+	SQLiteImporter & map(const std::string & source, const std::string & column, ColumnType type = ColumnAuto);
+
+	// Maps CSV column by its zero-based index.
+	SQLiteImporter & map(size_t sourceIndex, const std::string & column, ColumnType type = ColumnAuto);
+
+	inline void setBadLineCallback(const BadLineCallback & callback) { m_OnBadLine = callback; }
+	inline void setProgressCallback(const ProgressCallback & callback) { m_OnProgress = callback; }
+
+	// Imports the whole file. Rows are committed every `commitSize` rows, or earlier when the parsers fall
+	// behind (the database is not locked while waiting for them), so on failure rows committed by earlier
+	// transactions remain in the table. Indexes dropped for the load are recreated in any case.
+	Stats importFile(const std::string & path);
+
+private:
+	struct Mapping
+	{
+		std::string source;
+		size_t sourceIndex;
+		std::string column;
+		ColumnType type;
+	};
+
+	class Pipeline;
+
+	SQLiteDatabase & m_Database;
+	std::string m_Table;
+	Options m_Options;
+	std::vector<Mapping> m_Mappings;
+	BadLineCallback m_OnBadLine;
+	ProgressCallback m_OnProgress;
+
+	std::vector<std::string> tableColumns();
+	std::string insertStatement(const std::vector<Mapping> & mappings) const;
+
+	SQLiteImporter(const SQLiteImporter &) = delete;
+	SQLiteImporter & operator=(const SQLiteImporter &) = delete;
+};
+
+#endif
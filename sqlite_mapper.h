@@ -0,0 +1,308 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __8575c12a3ca8bcca749bf270b11f25ab__
+#define __8575c12a3ca8bcca749bf270b11f25ab__
+
+#include "sqlite_database.h"
+#include "sqlite_traits.h"
+#include <yip-imports/sqlite3.h>
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <type_traits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <tuple>
+
+// Maps structs to rows of a table. Fields are declared once per type, at global namespace scope:
+//
+//   struct Person { sqlite3_int64 id; std::string name; double score; };
+//
+//   SQLITE_MAPPED_TYPE(Person, "people",
+//       SQLITE_FIELD(id),
+//       SQLITE_FIELD_NAMED(name, "full_name"),
+//       SQLITE_FIELD(score));
+//
+//   SQLiteMapper<Person> people(db);
+//   people.insert(person);
+//   std::vector<Person> best = people.selectWhere("score > ? ORDER BY score DESC", 4.5);
+//
+// Values are converted with SQLiteTraits of the field types, and the column of each field is its position in
+// the declaration, so binding and extraction are resolved at compile time. SQL is generated once per type and
+// statements are taken from the statement cache of the connection, so they are prepared only once. Fields are
+// bound by value, so a rowid alias that should be assigned by SQLite has to be NULL when inserted (declare it
+// as std::optional in C++17). Mapped types should be default-constructible.
+
+// Field of a mapped type, see SQLITE_FIELD.
+template <class CLASS, class TYPE, TYPE CLASS::* MEMBER> struct SQLiteMappedField
+{
+	const char * name;
+
+	inline constexpr explicit SQLiteMappedField(const char * columnName) noexcept : name(columnName) {}
+
+	static inline int bind(sqlite3_stmt * stmt, int index, const CLASS & object) noexcept
+		{ return SQLiteTraits<TYPE>::bind(stmt, index, object.*MEMBER); }
+	static inline void read(sqlite3_stmt * stmt, int index, CLASS & object)
+		{ object.*MEMBER = SQLiteTraits<TYPE>::column(stmt, index); }
+};
+
+// Specialized by SQLITE_MAPPED_TYPE with static `table()` and `fields()` methods.
+template <class T> struct SQLiteMapping;
+
+#define SQLITE_FIELD(MEMBER) \
+	SQLiteMappedField<Type, decltype(Type::MEMBER), &Type::MEMBER>(#MEMBER)
+#define SQLITE_FIELD_NAMED(MEMBER, COLUMN) \
+	SQLiteMappedField<Type, decltype(Type::MEMBER), &Type::MEMBER>(COLUMN)
+
+#define SQLITE_MAPPED_TYPE(TYPE, TABLE, ...) \
+	template <> struct SQLiteMapping<TYPE> \
+	{ \
+		typedef TYPE Type; \
+		static inline const char * table() noexcept { return TABLE; } \
+		static inline auto fields() -> decltype(std::make_tuple(__VA_ARGS__)) \
+			{ return std::make_tuple(__VA_ARGS__); } \
+	}
+
+template <class T> class SQLiteMapper
+{
+public:
+	typedef SQLiteMapping<T> Mapping;
+	typedef decltype(Mapping::fields()) Fields;
+
+	enum { NumFields = std::tuple_size<Fields>::value };
+
+	explicit inline SQLiteMapper(SQLiteDatabase & database) noexcept : m_Database(database) {}
+
+	inline SQLiteDatabase & database() const noexcept { return m_Database; }
+
+	// Return rowid of the inserted row.
+	inline sqlite3_int64 insert(const T & object) { return write(insertSQL(), object); }
+	inline sqlite3_int64 replace(const T & object) { return write(replaceSQL(), object); }
+
+	// Inserts all objects with a single statement inside of one transaction (a savepoint, if a transaction is
+	// already active). Returns number of inserted objects.
+	template <class ITER> size_t insert(ITER begin, ITER end);
+	inline size_t insert(const std::vector<T> & objects) { return insert(objects.begin(), objects.end()); }
+
+	inline std::vector<T> selectAll() { return select(selectSQL()); }
+
+	// `where` is appended to the query after WHERE and may contain ORDER BY and LIMIT clauses. Arguments are
+	// bound to its parameters 1..N.
+	template <class... ARGS> inline std::vector<T> selectWhere(const std::string & where, const ARGS &... args)
+		{ return select(selectSQL() + " WHERE " + where, args...); }
+
+	inline sqlite3_int64 count() { return queryCount(countSQL()); }
+	template <class... ARGS> inline sqlite3_int64 count(const std::string & where, const ARGS &... args)
+		{ return queryCount(countSQL() + " WHERE " + where, args...); }
+
+	static const std::string & insertSQL() { static const std::string sql = writeSQL("INSERT"); return sql; }
+	static const std::string & replaceSQL() { static const std::string sql = writeSQL("REPLACE"); return sql; }
+	static const std::string & selectSQL();
+	static const std::string & countSQL();
+
+private:
+	typedef typename SQLiteMakeIndices<NumFields>::Type FieldIndices;
+
+	SQLiteDatabase & m_Database;
+
+	template <class FUNC> void withStatement(const std::string & sql, FUNC && body);
+
+	sqlite3_int64 write(const std::string & sql, const T & object);
+	template <class... ARGS> std::vector<T> select(const std::string & sql, const ARGS &... args);
+	template <class... ARGS> sqlite3_int64 queryCount(const std::string & sql, const ARGS &... args);
+
+	static void checkBind(sqlite3_stmt * stmt, int index, int err);
+
+	template <size_t... N> static void bindFields(sqlite3_stmt * stmt, const T & object, SQLiteIndices<N...>);
+	template <size_t... N> static void readFields(sqlite3_stmt * stmt, T & object, SQLiteIndices<N...>);
+
+	static inline void bindArgs(sqlite3_stmt *, int) {}
+	template <class ARG, class... ARGS> static void bindArgs(sqlite3_stmt * stmt, int index, const ARG & arg,
+		const ARGS &... args);
+
+	template <size_t... N> static std::string columnList(const Fields & fields, SQLiteIndices<N...>);
+	static std::string quoteIdentifier(const char * name);
+	static std::string writeSQL(const char * verb);
+
+	SQLiteMapper(const SQLiteMapper &) = delete;
+	SQLiteMapper & operator=(const SQLiteMapper &) = delete;
+};
+
+template <class T> const std::string & SQLiteMapper<T>::selectSQL()
+{
+	static const std::string sql = "SELECT " + columnList(Mapping::fields(), FieldIndices())
+		+ " FROM " + quoteIdentifier(Mapping::table());
+	return sql;
+}
+
+template <class T> const std::string & SQLiteMapper<T>::countSQL()
+{
+	static const std::string sql = "SELECT count(*) FROM " + quoteIdentifier(Mapping::table());
+	return sql;
+}
+
+template <class T> template <class ITER> size_t SQLiteMapper<T>::insert(ITER begin, ITER end)
+{
+	size_t count = 0;
+	m_Database.transaction([this, &begin, end, &count]() {
+		withStatement(insertSQL(), [&begin, end, &count](SQLiteDatabase::Locker & locker, sqlite3_stmt * stmt) {
+			for (; begin != end; ++begin, ++count)
+			{
+				bindFields(stmt, *begin, FieldIndices());
+				SQLiteDatabase::exec(locker, stmt);
+			}
+		});
+	});
+	return count;
+}
+
+template <class T> template <class FUNC> void SQLiteMapper<T>::withStatement(const std::string & sql, FUNC && body)
+{
+	SQLiteDatabase::Locker locker(m_Database);
+
+	sqlite3_stmt * stmt = m_Database.m_StatementCache.acquire(m_Database.m_Handle, sql.c_str());
+	try
+	{
+		body(locker, stmt);
+	}
+	catch (...)
+	{
+		locker.relock();
+		m_Database.m_StatementCache.release(stmt, true);
+		throw;
+	}
+
+	m_Database.m_StatementCache.release(stmt);
+}
+
+template <class T> sqlite3_int64 SQLiteMapper<T>::write(const std::string & sql, const T & object)
+{
+	sqlite3_int64 rowid = 0;
+	withStatement(sql, [this, &object, &rowid](SQLiteDatabase::Locker & locker, sqlite3_stmt * stmt) {
+		bindFields(stmt, object, FieldIndices());
+		SQLiteDatabase::exec(locker, stmt);
+		rowid = m_Database.lastInsertId();
+	});
+	return rowid;
+}
+
+template <class T> template <class... ARGS>
+std::vector<T> SQLiteMapper<T>::select(const std::string & sql, const ARGS &... args)
+{
+	std::vector<T> result;
+	withStatement(sql, [&result, &args...](SQLiteDatabase::Locker & locker, sqlite3_stmt * stmt) {
+		bindArgs(stmt, 1, args...);
+		SQLiteDatabase::execRows(locker, stmt, SQLiteDatabase::NoLimit, [&result, stmt]() {
+			result.emplace_back();
+			readFields(stmt, result.back(), FieldIndices());
+		});
+	});
+	return result;
+}
+
+template <class T> template <class... ARGS>
+sqlite3_int64 SQLiteMapper<T>::queryCount(const std::string & sql, const ARGS &... args)
+{
+	sqlite3_int64 count = 0;
+	withStatement(sql, [&count, &args...](SQLiteDatabase::Locker & locker, sqlite3_stmt * stmt) {
+		bindArgs(stmt, 1, args...);
+		SQLiteDatabase::execRows(locker, stmt, 1, [&count, stmt]() { count = sqlite3_column_int64(stmt, 0); });
+	});
+	return count;
+}
+
+template <class T> void SQLiteMapper<T>::checkBind(sqlite3_stmt * stmt, int index, int err)
+{
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		throw std::runtime_error(fmt() << "unable to bind value for parameter #" << index << " of query '"
+			<< sqlite3_sql(stmt) << "': " << sqlite3_errstr(err));
+	}
+}
+
+template <class T> template <size_t... N>
+void SQLiteMapper<T>::bindFields(sqlite3_stmt * stmt, const T & object, SQLiteIndices<N...>)
+{
+	int dummy[] = { 0, (checkBind(stmt, int(N + 1),
+		std::tuple_element<N, Fields>::type::bind(stmt, int(N + 1), object)), 0)... };
+	(void)dummy;
+}
+
+template <class T> template <size_t... N>
+void SQLiteMapper<T>::readFields(sqlite3_stmt * stmt, T & object, SQLiteIndices<N...>)
+{
+	int dummy[] = { 0, (std::tuple_element<N, Fields>::type::read(stmt, int(N), object), 0)... };
+	(void)dummy;
+}
+
+template <class T> template <class ARG, class... ARGS>
+void SQLiteMapper<T>::bindArgs(sqlite3_stmt * stmt, int index, const ARG & arg, const ARGS &... args)
+{
+	checkBind(stmt, index, SQLiteTraits<typename std::decay<ARG>::type>::bind(stmt, index, arg));
+	bindArgs(stmt, index + 1, args...);
+}
+
+template <class T> template <size_t... N>
+std::string SQLiteMapper<T>::columnList(const Fields & fields, SQLiteIndices<N...>)
+{
+	const char * names[] = { std::get<N>(fields).name... };
+
+	std::string result;
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		if (i > 0)
+			result += ", ";
+		result += quoteIdentifier(names[i]);
+	}
+
+	return result;
+}
+
+template <class T> std::string SQLiteMapper<T>::quoteIdentifier(const char * name)
+{
+	std::string result = "\"";
+	for (; *name; ++name)
+	{
+		if (*name == '"')
+			result += '"';
+		result += *name;
+	}
+	result += '"';
+	return result;
+}
+
+template <class T> std::string SQLiteMapper<T>::writeSQL(const char * verb)
+{
+	std::string sql = verb;
+	sql += " INTO ";
+	sql += quoteIdentifier(Mapping::table());
+	sql += " (";
+	sql += columnList(Mapping::fields(), FieldIndices());
+	sql += ") VALUES (";
+	for (size_t i = 0; i < NumFields; i++)
+		sql += (i > 0 ? ", ?" : "?");
+	sql += ')';
+	return sql;
+}
+
+#endif
@@ -0,0 +1,115 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_open_options.h"
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+#include <sstream>
+
+const int64_t SQLiteOpenOptions::NotSet;
+
+SQLiteOpenOptions::SQLiteOpenOptions() noexcept
+	: flags(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE),
+	  journalMode(JournalDefault),
+	  synchronous(SynchronousDefault),
+	  tempStore(TempStoreDefault),
+	  lockingMode(LockingDefault),
+	  mmapSize(NotSet),
+	  cacheSize(NotSet),
+	  pageSize(NotSet),
+	  walAutoCheckpoint(NotSet)
+{
+}
+
+SQLiteOpenOptions SQLiteOpenOptions::bulkLoad()
+{
+	SQLiteOpenOptions options;
+	options.journalMode = JournalMemory;
+	options.synchronous = SynchronousOff;
+	options.tempStore = TempStoreMemory;
+	options.lockingMode = LockingExclusive;
+	options.cacheSize = -262144;
+	return options;
+}
+
+SQLiteOpenOptions SQLiteOpenOptions::readHeavyServer()
+{
+	SQLiteOpenOptions options;
+	options.journalMode = JournalWAL;
+	options.synchronous = SynchronousNormal;
+	options.tempStore = TempStoreMemory;
+	options.mmapSize = 268435456;
+	options.cacheSize = -65536;
+	options.walAutoCheckpoint = 1000;
+	return options;
+}
+
+SQLiteOpenOptions SQLiteOpenOptions::durableOLTP()
+{
+	SQLiteOpenOptions options;
+	options.journalMode = JournalWAL;
+	options.synchronous = SynchronousFull;
+	options.cacheSize = -16384;
+	options.walAutoCheckpoint = 1000;
+	return options;
+}
+
+SQLiteOpenOptions SQLiteOpenOptions::profile(const std::string & name)
+{
+	if (name == "bulk-load")
+		return bulkLoad();
+	if (name == "read-heavy-server")
+		return readHeavyServer();
+	if (name == "durable-oltp")
+		return durableOLTP();
+	throw std::runtime_error(fmt() << "unknown database tuning profile '" << name << "'.");
+}
+
+std::string SQLiteOpenOptions::pragmas() const
+{
+	static const char * const journalModes[] = { nullptr, "DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF" };
+	static const char * const synchronousModes[] = { nullptr, "OFF", "NORMAL", "FULL", "EXTRA" };
+	static const char * const tempStores[] = { nullptr, "FILE", "MEMORY" };
+	static const char * const lockingModes[] = { nullptr, "NORMAL", "EXCLUSIVE" };
+
+	std::stringstream ss;
+
+	// Page size could not be changed in WAL mode, so it should be set before the journal mode
+	if (pageSize != NotSet)
+		ss << "PRAGMA page_size = " << pageSize << ";";
+	if (lockingMode != LockingDefault)
+		ss << "PRAGMA locking_mode = " << lockingModes[lockingMode] << ";";
+	if (journalMode != JournalDefault)
+		ss << "PRAGMA journal_mode = " << journalModes[journalMode] << ";";
+	if (synchronous != SynchronousDefault)
+		ss << "PRAGMA synchronous = " << synchronousModes[synchronous] << ";";
+	if (tempStore != TempStoreDefault)
+		ss << "PRAGMA temp_store = " << tempStores[tempStore] << ";";
+	if (mmapSize != NotSet)
+		ss << "PRAGMA mmap_size = " << mmapSize << ";";
+	if (cacheSize != NotSet)
+		ss << "PRAGMA cache_size = " << cacheSize << ";";
+	if (walAutoCheckpoint != NotSet)
+		ss << "PRAGMA wal_autocheckpoint = " << walAutoCheckpoint << ";";
+
+	return ss.str();
+}
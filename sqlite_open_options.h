@@ -0,0 +1,101 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __a2cd32435128dc0d094939f43e63d143__
+#define __a2cd32435128dc0d094939f43e63d143__
+
+#include <yip-imports/sqlite3.h>
+#include <string>
+#include <limits>
+#include <cstdint>
+
+// Options for opening the database. Flags are passed to sqlite3_open_v2 (use SQLITE_OPEN_URI to open URI
+// filenames, e.g. "file:data.db?immutable=1"). PRAGMAs that are not set keep SQLite defaults.
+struct SQLiteOpenOptions
+{
+	enum JournalMode
+	{
+		JournalDefault = 0,
+		JournalDelete,
+		JournalTruncate,
+		JournalPersist,
+		JournalMemory,
+		JournalWAL,
+		JournalOff,
+	};
+
+	enum Synchronous
+	{
+		SynchronousDefault = 0,
+		SynchronousOff,
+		SynchronousNormal,
+		SynchronousFull,
+		SynchronousExtra,
+	};
+
+	enum TempStore
+	{
+		TempStoreDefault = 0,
+		TempStoreFile,
+		TempStoreMemory,
+	};
+
+	enum LockingMode
+	{
+		LockingDefault = 0,
+		LockingNormal,
+		LockingExclusive,
+	};
+
+	static const int64_t NotSet = std::numeric_limits<int64_t>::min();
+
+	int flags;
+	std::string vfs;
+	JournalMode journalMode;
+	Synchronous synchronous;
+	TempStore tempStore;
+	LockingMode lockingMode;
+	int64_t mmapSize;
+	int64_t cacheSize;    // Negative values are in KiB, positive values in pages
+	int64_t pageSize;
+	int64_t walAutoCheckpoint;
+
+	SQLiteOpenOptions() noexcept;
+
+	// Fast loading of large amounts of data: no fsyncs, in-memory journal, exclusive lock and a big cache.
+	// Database could be corrupted if the process crashes during the load.
+	static SQLiteOpenOptions bulkLoad();
+
+	// Many concurrent readers: WAL, relaxed fsyncs, memory-mapped I/O and a big cache.
+	static SQLiteOpenOptions readHeavyServer();
+
+	// Transactions are durable once committed: WAL with full fsync on every commit.
+	static SQLiteOpenOptions durableOLTP();
+
+	// Returns preset by name: "bulk-load", "read-heavy-server" or "durable-oltp".
+	static SQLiteOpenOptions profile(const std::string & name);
+
+	// Returns PRAGMA statements applying these options, separated with semicolons.
+	std::string pragmas() const;
+};
+
+#endif
@@ -0,0 +1,439 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_profiler.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cctype>
+
+namespace
+{
+	const size_t MaxRawSQLCacheSize = 4096;
+
+	inline bool isIdentifierChar(char ch) noexcept
+	{
+		return isalnum(static_cast<unsigned char>(ch)) || ch == '_' || ch == '$' || (ch & 0x80) != 0;
+	}
+
+	inline size_t latencyBucket(uint64_t nanoseconds) noexcept
+	{
+		size_t bucket = 0;
+		while (nanoseconds > 1 && bucket < SQLiteProfiler::NumLatencyBuckets - 1)
+		{
+			nanoseconds >>= 1;
+			++bucket;
+		}
+		return bucket;
+	}
+
+	void writeJSONString(std::ostream & out, const std::string & str)
+	{
+		out << '"';
+		for (char ch : str)
+		{
+			switch (ch)
+			{
+			case '"': out << "\\\""; break;
+			case '\\': out << "\\\\"; break;
+			case '\n': out << "\\n"; break;
+			case '\r': out << "\\r"; break;
+			case '\t': out << "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(ch) < 0x20)
+				{
+					out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(ch)
+						<< std::dec << std::setfill(' ');
+				}
+				else
+					out << ch;
+			}
+		}
+		out << '"';
+	}
+}
+
+/* SQLiteProfiler::StatementStats */
+
+SQLiteProfiler::StatementStats::StatementStats() noexcept
+	: calls(0),
+	  rows(0),
+	  totalNanoseconds(0),
+	  maxNanoseconds(0),
+	  fullscanSteps(0),
+	  sorts(0),
+	  autoIndexes(0),
+	  vmSteps(0),
+	  reprepares(0),
+	  maxMemoryUsed(0)
+{
+	memset(latencyHistogram, 0, sizeof(latencyHistogram));
+}
+
+uint64_t SQLiteProfiler::StatementStats::percentileNanoseconds(double fraction) const noexcept
+{
+	if (calls == 0)
+		return 0;
+
+	double target = std::min(std::max(fraction, 0.0), 1.0) * double(calls);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < NumLatencyBuckets; i++)
+	{
+		uint64_t count = latencyHistogram[i];
+		if (count == 0 || double(seen + count) < target)
+		{
+			seen += count;
+			continue;
+		}
+
+		// Interpolate linearly inside of the bucket
+		double lower = (i == 0 ? 0.0 : double(uint64_t(1) << i));
+		double upper = double(uint64_t(1) << i) * 2.0;
+		uint64_t value = uint64_t(lower + (upper - lower) * (target - double(seen)) / double(count));
+		return std::min(value, maxNanoseconds);
+	}
+
+	return maxNanoseconds;
+}
+
+
+/* SQLiteProfiler::Report */
+
+std::string SQLiteProfiler::Report::toText() const
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+
+	out << "locks: " << locks.acquisitions << " acquisitions, wait " << double(locks.waitNanoseconds) / 1000.0
+		<< " us (max " << double(locks.maxWaitNanoseconds) / 1000.0 << " us), hold "
+		<< double(locks.holdNanoseconds) / 1000.0 << " us (max " << double(locks.maxHoldNanoseconds) / 1000.0
+		<< " us)\n";
+
+	out << std::setw(10) << "calls" << std::setw(12) << "total_ms" << std::setw(10) << "p50_us"
+		<< std::setw(10) << "p99_us" << std::setw(10) << "max_us" << std::setw(10) << "rows"
+		<< std::setw(10) << "fullscan" << std::setw(8) << "sorts" << std::setw(8) << "autoidx"
+		<< std::setw(12) << "vm_steps" << std::setw(8) << "reprep" << std::setw(10) << "mem" << "  sql\n";
+
+	for (const StatementStats & stats : statements)
+	{
+		out << std::setw(10) << stats.calls
+			<< std::setw(12) << double(stats.totalNanoseconds) / 1000000.0
+			<< std::setw(10) << double(stats.p50Nanoseconds()) / 1000.0
+			<< std::setw(10) << double(stats.p99Nanoseconds()) / 1000.0
+			<< std::setw(10) << double(stats.maxNanoseconds) / 1000.0
+			<< std::setw(10) << stats.rows
+			<< std::setw(10) << stats.fullscanSteps
+			<< std::setw(8) << stats.sorts
+			<< std::setw(8) << stats.autoIndexes
+			<< std::setw(12) << stats.vmSteps
+			<< std::setw(8) << stats.reprepares
+			<< std::setw(10) << stats.maxMemoryUsed
+			<< "  " << stats.sql << '\n';
+	}
+
+	return out.str();
+}
+
+std::string SQLiteProfiler::Report::toJSON() const
+{
+	std::ostringstream out;
+
+	out << "{\"locks\":{\"acquisitions\":" << locks.acquisitions
+		<< ",\"waitNanoseconds\":" << locks.waitNanoseconds
+		<< ",\"maxWaitNanoseconds\":" << locks.maxWaitNanoseconds
+		<< ",\"holdNanoseconds\":" << locks.holdNanoseconds
+		<< ",\"maxHoldNanoseconds\":" << locks.maxHoldNanoseconds
+		<< "},\"statements\":[";
+
+	bool first = true;
+	for (const StatementStats & stats : statements)
+	{
+		if (!first)
+			out << ',';
+		first = false;
+
+		out << "{\"sql\":";
+		writeJSONString(out, stats.sql);
+		out << ",\"calls\":" << stats.calls
+			<< ",\"rows\":" << stats.rows
+			<< ",\"totalNanoseconds\":" << stats.totalNanoseconds
+			<< ",\"p50Nanoseconds\":" << stats.p50Nanoseconds()
+			<< ",\"p99Nanoseconds\":" << stats.p99Nanoseconds()
+			<< ",\"maxNanoseconds\":" << stats.maxNanoseconds
+			<< ",\"fullscanSteps\":" << stats.fullscanSteps
+			<< ",\"sorts\":" << stats.sorts
+			<< ",\"autoIndexes\":" << stats.autoIndexes
+			<< ",\"vmSteps\":" << stats.vmSteps
+			<< ",\"reprepares\":" << stats.reprepares
+			<< ",\"maxMemoryUsed\":" << stats.maxMemoryUsed
+			<< '}';
+	}
+
+	out << "]}";
+	return out.str();
+}
+
+
+/* SQLiteProfiler */
+
+SQLiteProfiler::SQLiteProfiler()
+{
+	memset(&m_Locks, 0, sizeof(m_Locks));
+}
+
+SQLiteProfiler::~SQLiteProfiler()
+{
+}
+
+SQLiteProfiler::Report SQLiteProfiler::report() const
+{
+	Report report;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		report.statements = m_Statements;
+		report.locks = m_Locks;
+	}
+
+	std::sort(report.statements.begin(), report.statements.end(),
+		[](const StatementStats & a, const StatementStats & b) { return a.totalNanoseconds > b.totalNanoseconds; });
+
+	return report;
+}
+
+void SQLiteProfiler::reset()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Statements.clear();
+	m_ByNormalizedSQL.clear();
+	m_ByRawSQL.clear();
+	memset(&m_Locks, 0, sizeof(m_Locks));
+}
+
+std::string SQLiteProfiler::normalizeSQL(const char * sql)
+{
+	std::string result;
+	if (!sql)
+		return result;
+
+	result.reserve(strlen(sql));
+	const char * p = sql;
+	while (*p)
+	{
+		char ch = *p;
+		if (isspace(static_cast<unsigned char>(ch)))
+		{
+			while (isspace(static_cast<unsigned char>(*p)))
+				++p;
+			if (!result.empty())
+				result += ' ';
+		}
+		else if (ch == '\'')
+		{
+			// String literal; quotes inside of it are doubled
+			for (++p; *p; ++p)
+			{
+				if (*p == '\'')
+				{
+					if (p[1] != '\'')
+					{
+						++p;
+						break;
+					}
+					++p;
+				}
+			}
+			result += '?';
+		}
+		else if (ch == '"' || ch == '`' || ch == '[')
+		{
+			// Quoted identifier is kept as is
+			char quote = (ch == '[' ? ']' : ch);
+			result += *p++;
+			while (*p && *p != quote)
+				result += *p++;
+			if (*p)
+				result += *p++;
+		}
+		else if ((isdigit(static_cast<unsigned char>(ch)) || (ch == '.' && isdigit(static_cast<unsigned char>(p[1]))))
+			&& (result.empty() || !isIdentifierChar(result.back())))
+		{
+			while (isIdentifierChar(*p) || *p == '.'
+					|| ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E')))
+				++p;
+			result += '?';
+		}
+		else if ((ch == 'x' || ch == 'X') && p[1] == '\'' && (result.empty() || !isIdentifierChar(result.back())))
+		{
+			// Blob literal
+			for (p += 2; *p && *p != '\''; ++p)
+				;
+			if (*p)
+				++p;
+			result += '?';
+		}
+		else if (isIdentifierChar(ch))
+		{
+			while (isIdentifierChar(*p))
+				result += *p++;
+		}
+		else
+			result += *p++;
+	}
+
+	while (!result.empty() && (result.back() == ' ' || result.back() == ';'))
+		result.pop_back();
+
+	return result;
+}
+
+void SQLiteProfiler::recordStart(sqlite3_stmt * stmt)
+{
+	Execution execution;
+	execution.startTime = std::chrono::steady_clock::now();
+	execution.rows = 0;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Executions[stmt] = execution;
+}
+
+void SQLiteProfiler::recordRow(sqlite3_stmt * stmt)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto it = m_Executions.find(stmt);
+	if (LIKELY(it != m_Executions.end()))
+		++it->second.rows;
+}
+
+void SQLiteProfiler::recordStatement(sqlite3_stmt * stmt, uint64_t sqliteNanoseconds)
+{
+	auto endTime = std::chrono::steady_clock::now();
+
+	const char * sql = sqlite3_sql(stmt);
+	if (!sql)
+		sql = "";
+
+	// Counters are reset so that next execution of the same statement reports only its own work
+	uint64_t fullscanSteps = uint64_t(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1));
+	uint64_t sorts = uint64_t(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1));
+	uint64_t autoIndexes = uint64_t(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1));
+	uint64_t vmSteps = uint64_t(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1));
+#ifdef SQLITE_STMTSTATUS_REPREPARE
+	uint64_t reprepares = uint64_t(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_REPREPARE, 1));
+#else
+	uint64_t reprepares = 0;
+#endif
+#ifdef SQLITE_STMTSTATUS_MEMUSED
+	uint64_t memoryUsed = uint64_t(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_MEMUSED, 0));
+#else
+	uint64_t memoryUsed = 0;
+#endif
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	size_t index;
+	auto it = m_ByRawSQL.find(sql);
+	if (LIKELY(it != m_ByRawSQL.end()))
+		index = it->second;
+	else
+	{
+		std::string normalized = normalizeSQL(sql);
+		auto jt = m_ByNormalizedSQL.find(normalized);
+		if (jt != m_ByNormalizedSQL.end())
+			index = jt->second;
+		else
+		{
+			index = m_Statements.size();
+			m_Statements.emplace_back();
+			m_Statements.back().sql = normalized;
+			m_ByNormalizedSQL.emplace(std::move(normalized), index);
+		}
+
+		// Statements with inline literals would grow this map indefinitely
+		if (UNLIKELY(m_ByRawSQL.size() >= MaxRawSQLCacheSize))
+			m_ByRawSQL.clear();
+		m_ByRawSQL.emplace(sql, index);
+	}
+
+	// Time reported by SQLite comes from the VFS clock, which usually has millisecond resolution
+	uint64_t nanoseconds = sqliteNanoseconds, rows = 0;
+	auto jt = m_Executions.find(stmt);
+	if (LIKELY(jt != m_Executions.end()))
+	{
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - jt->second.startTime);
+		nanoseconds = uint64_t(elapsed.count());
+		rows = jt->second.rows;
+		m_Executions.erase(jt);
+	}
+
+	StatementStats & stats = m_Statements[index];
+	++stats.calls;
+	stats.rows += rows;
+	stats.totalNanoseconds += nanoseconds;
+	stats.maxNanoseconds = std::max(stats.maxNanoseconds, nanoseconds);
+	++stats.latencyHistogram[latencyBucket(nanoseconds)];
+	stats.fullscanSteps += fullscanSteps;
+	stats.sorts += sorts;
+	stats.autoIndexes += autoIndexes;
+	stats.vmSteps += vmSteps;
+	stats.reprepares += reprepares;
+	stats.maxMemoryUsed = std::max(stats.maxMemoryUsed, memoryUsed);
+}
+
+void SQLiteProfiler::recordLock(uint64_t waitNanoseconds, uint64_t holdNanoseconds) noexcept
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	++m_Locks.acquisitions;
+	m_Locks.waitNanoseconds += waitNanoseconds;
+	m_Locks.maxWaitNanoseconds = std::max(m_Locks.maxWaitNanoseconds, waitNanoseconds);
+	m_Locks.holdNanoseconds += holdNanoseconds;
+	m_Locks.maxHoldNanoseconds = std::max(m_Locks.maxHoldNanoseconds, holdNanoseconds);
+}
+
+int SQLiteProfiler::traceCallback(unsigned type, void * self, void * p, void * x)
+{
+	SQLiteProfiler * profiler = reinterpret_cast<SQLiteProfiler *>(self);
+	try
+	{
+		if (type == SQLITE_TRACE_STMT)
+		{
+			// Statements of triggers are reported as comments; they are a part of the outer statement
+			const char * sql = reinterpret_cast<const char *>(x);
+			if (!sql || sql[0] != '-' || sql[1] != '-')
+				profiler->recordStart(reinterpret_cast<sqlite3_stmt *>(p));
+		}
+		else if (type == SQLITE_TRACE_ROW)
+			profiler->recordRow(reinterpret_cast<sqlite3_stmt *>(p));
+		else if (type == SQLITE_TRACE_PROFILE)
+		{
+			sqlite3_int64 nanoseconds = *reinterpret_cast<sqlite3_int64 *>(x);
+			profiler->recordStatement(reinterpret_cast<sqlite3_stmt *>(p), uint64_t(nanoseconds));
+		}
+	}
+	catch (...)
+	{
+		// Statistics are lost if we are out of memory
+	}
+	return 0;
+}
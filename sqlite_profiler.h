@@ -0,0 +1,120 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __237350538fbc667297b791f7deccbd2a__
+#define __237350538fbc667297b791f7deccbd2a__
+
+#include <yip-imports/sqlite3.h>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// Registry of per-statement execution statistics. Attach it to one or more databases with
+// `SQLiteDatabase::setProfiler`; statistics are aggregated by normalized SQL text (literals replaced with '?'
+// and whitespace collapsed). Profiler should outlive all databases it is attached to.
+class SQLiteProfiler
+{
+public:
+	enum { NumLatencyBuckets = 64 };
+
+	struct StatementStats
+	{
+		std::string sql;
+		uint64_t calls;
+		uint64_t rows;
+		uint64_t totalNanoseconds;
+		uint64_t maxNanoseconds;
+		uint64_t fullscanSteps;
+		uint64_t sorts;
+		uint64_t autoIndexes;
+		uint64_t vmSteps;
+		uint64_t reprepares;
+		uint64_t maxMemoryUsed;
+		uint64_t latencyHistogram[NumLatencyBuckets];   // Bucket N counts executions of [2^N, 2^(N+1)) ns
+
+		StatementStats() noexcept;
+
+		// Estimated from the histogram; `fraction` is in range [0, 1].
+		uint64_t percentileNanoseconds(double fraction) const noexcept;
+		inline uint64_t p50Nanoseconds() const noexcept { return percentileNanoseconds(0.50); }
+		inline uint64_t p99Nanoseconds() const noexcept { return percentileNanoseconds(0.99); }
+	};
+
+	// Time spent waiting for and holding the database mutex in `SQLiteDatabase::Locker`. Nested acquisitions by
+	// the thread already holding the mutex are not counted.
+	struct LockStats
+	{
+		uint64_t acquisitions;
+		uint64_t waitNanoseconds;
+		uint64_t maxWaitNanoseconds;
+		uint64_t holdNanoseconds;
+		uint64_t maxHoldNanoseconds;
+	};
+
+	struct Report
+	{
+		std::vector<StatementStats> statements;     // Sorted by total execution time, slowest first
+		LockStats locks;
+
+		std::string toText() const;
+		std::string toJSON() const;
+	};
+
+	SQLiteProfiler();
+	~SQLiteProfiler();
+
+	Report report() const;
+	void reset();
+
+	static std::string normalizeSQL(const char * sql);
+
+private:
+	struct Execution
+	{
+		std::chrono::steady_clock::time_point startTime;
+		uint64_t rows;
+	};
+
+	mutable std::mutex m_Mutex;
+	std::vector<StatementStats> m_Statements;
+	std::unordered_map<std::string, size_t> m_ByNormalizedSQL;
+	std::unordered_map<std::string, size_t> m_ByRawSQL;
+	std::unordered_map<sqlite3_stmt *, Execution> m_Executions;
+	LockStats m_Locks;
+
+	void recordStart(sqlite3_stmt * stmt);
+	void recordRow(sqlite3_stmt * stmt);
+	void recordStatement(sqlite3_stmt * stmt, uint64_t sqliteNanoseconds);
+	void recordLock(uint64_t waitNanoseconds, uint64_t holdNanoseconds) noexcept;
+
+	static int traceCallback(unsigned type, void * self, void * p, void * x);
+
+	SQLiteProfiler(const SQLiteProfiler &) = delete;
+	SQLiteProfiler & operator=(const SQLiteProfiler &) = delete;
+
+	friend class SQLiteDatabase;
+};
+
+#endif
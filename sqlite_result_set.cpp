@@ -0,0 +1,183 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_result_set.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+
+SQLiteResultSet::SQLiteResultSet()
+	: m_NumRows(0),
+	  m_NumColumns(0)
+{
+}
+
+SQLiteResultSet::SQLiteResultSet(SQLiteResultSet && other) noexcept
+	: m_Cells(std::move(other.m_Cells)),
+	  m_Bytes(std::move(other.m_Bytes)),
+	  m_ColumnNames(std::move(other.m_ColumnNames)),
+	  m_ColumnIndices(std::move(other.m_ColumnIndices)),
+	  m_NumRows(other.m_NumRows),
+	  m_NumColumns(other.m_NumColumns)
+{
+	other.m_NumRows = 0;
+	other.m_NumColumns = 0;
+}
+
+SQLiteResultSet::~SQLiteResultSet()
+{
+}
+
+SQLiteResultSet & SQLiteResultSet::operator=(SQLiteResultSet && other) noexcept
+{
+	m_Cells = std::move(other.m_Cells);
+	m_Bytes = std::move(other.m_Bytes);
+	m_ColumnNames = std::move(other.m_ColumnNames);
+	m_ColumnIndices = std::move(other.m_ColumnIndices);
+	m_NumRows = other.m_NumRows;
+	m_NumColumns = other.m_NumColumns;
+	other.m_NumRows = 0;
+	other.m_NumColumns = 0;
+	return *this;
+}
+
+int SQLiteResultSet::columnIndex(const char * name) const
+{
+	int index = columnIndex(name, std::nothrow);
+	if (index < 0)
+		throw std::runtime_error(fmt() << "there is no column '" << name << "' in the result set.");
+	return index;
+}
+
+int SQLiteResultSet::columnIndex(const std::string & name) const
+{
+	return columnIndex(name.c_str());
+}
+
+int SQLiteResultSet::columnIndex(const char * name, const std::nothrow_t &) const noexcept
+{
+	auto it = m_ColumnIndices.find(name);
+	return (it != m_ColumnIndices.end() ? it->second : -1);
+}
+
+int SQLiteResultSet::columnIndex(const std::string & name, const std::nothrow_t &) const noexcept
+{
+	auto it = m_ColumnIndices.find(name);
+	return (it != m_ColumnIndices.end() ? it->second : -1);
+}
+
+sqlite3_int64 SQLiteResultSet::toInt64(size_t row, int col) const noexcept
+{
+	const Cell & c = cell(row, col);
+	switch (c.type)
+	{
+	case SQLITE_INTEGER: return c.value.i;
+	case SQLITE_FLOAT: return static_cast<sqlite3_int64>(c.value.d);
+	case SQLITE_TEXT: return static_cast<sqlite3_int64>(strtoll(&m_Bytes[c.value.offset], nullptr, 10));
+	default: return 0;
+	}
+}
+
+double SQLiteResultSet::toDouble(size_t row, int col) const noexcept
+{
+	const Cell & c = cell(row, col);
+	switch (c.type)
+	{
+	case SQLITE_INTEGER: return static_cast<double>(c.value.i);
+	case SQLITE_FLOAT: return c.value.d;
+	case SQLITE_TEXT: return strtod(&m_Bytes[c.value.offset], nullptr);
+	default: return 0.0;
+	}
+}
+
+const void * SQLiteResultSet::toBlob(size_t row, int col) const noexcept
+{
+	const Cell & c = cell(row, col);
+	if (c.type != SQLITE_TEXT && c.type != SQLITE_BLOB)
+		return nullptr;
+	return &m_Bytes[c.value.offset];
+}
+
+void SQLiteResultSet::clear() noexcept
+{
+	m_Cells.clear();
+	m_Bytes.clear();
+	m_NumRows = 0;
+}
+
+void SQLiteResultSet::init(sqlite3_stmt * stmt)
+{
+	clear();
+
+	m_NumColumns = sqlite3_column_count(stmt);
+	m_ColumnNames.resize(size_t(m_NumColumns));
+	m_ColumnIndices.clear();
+	for (int i = 0; i < m_NumColumns; i++)
+	{
+		const char * name = sqlite3_column_name(stmt, i);
+		m_ColumnNames[size_t(i)] = (name ? name : "");
+		m_ColumnIndices.insert(std::make_pair(m_ColumnNames[size_t(i)], i));
+	}
+}
+
+void SQLiteResultSet::append(sqlite3_stmt * stmt)
+{
+	for (int i = 0; i < m_NumColumns; i++)
+	{
+		Cell c;
+		c.type = sqlite3_column_type(stmt, i);
+		c.size = 0;
+		switch (c.type)
+		{
+		case SQLITE_INTEGER:
+			c.value.i = sqlite3_column_int64(stmt, i);
+			break;
+
+		case SQLITE_FLOAT:
+			c.value.d = sqlite3_column_double(stmt, i);
+			break;
+
+		case SQLITE_TEXT:
+		case SQLITE_BLOB: {
+			const void * data = (c.type == SQLITE_TEXT ?
+				static_cast<const void *>(sqlite3_column_text(stmt, i)) : sqlite3_column_blob(stmt, i));
+			size_t size = static_cast<size_t>(sqlite3_column_bytes(stmt, i));
+			c.size = static_cast<uint32_t>(size);
+			c.value.offset = m_Bytes.size();
+			m_Bytes.resize(c.value.offset + size + 1);
+			if (size > 0)
+				memcpy(&m_Bytes[c.value.offset], data, size);
+			m_Bytes[c.value.offset + size] = 0;
+			break;
+			}
+
+		default:
+			c.type = SQLITE_NULL;
+			c.value.i = 0;
+		}
+		m_Cells.push_back(c);
+	}
+
+	++m_NumRows;
+}
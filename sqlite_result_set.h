@@ -0,0 +1,105 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __34058bc9fd32098e20d5f8adf28749aa__
+#define __34058bc9fd32098e20d5f8adf28749aa__
+
+#include "sqlite_cursor.h"
+#include <yip-imports/sqlite3.h>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <new>
+
+// Materialized query results. Fixed-width values of all cells are stored in a single row-major buffer and
+// bytes of all text and blob values are stored in a single arena, so filling the result set performs only a
+// few allocations regardless of the number of rows.
+class SQLiteResultSet
+{
+public:
+	SQLiteResultSet();
+	SQLiteResultSet(SQLiteResultSet && other) noexcept;
+	~SQLiteResultSet();
+
+	SQLiteResultSet & operator=(SQLiteResultSet && other) noexcept;
+
+	inline size_t numRows() const noexcept { return m_NumRows; }
+	inline int numColumns() const noexcept { return m_NumColumns; }
+	inline const std::string & columnName(int n) const noexcept { return m_ColumnNames[size_t(n)]; }
+
+	int columnIndex(const char * name) const;
+	int columnIndex(const std::string & name) const;
+
+	int columnIndex(const char * name, const std::nothrow_t &) const noexcept;
+	int columnIndex(const std::string & name, const std::nothrow_t &) const noexcept;
+
+	inline SQLiteCursor::ColumnType columnType(size_t row, int col) const noexcept
+		{ return SQLiteCursor::ColumnType(cell(row, col).type); }
+	inline bool isNull(size_t row, int col) const noexcept { return cell(row, col).type == SQLITE_NULL; }
+
+	inline int toInt(size_t row, int col) const noexcept { return static_cast<int>(toInt64(row, col)); }
+	sqlite3_int64 toInt64(size_t row, int col) const noexcept;
+	double toDouble(size_t row, int col) const noexcept;
+
+	inline size_t columnBytes(size_t row, int col) const noexcept
+		{ const Cell & c = cell(row, col); return (c.type == SQLITE_TEXT || c.type == SQLITE_BLOB ? c.size : 0); }
+	const void * toBlob(size_t row, int col) const noexcept;
+	inline const char * toText(size_t row, int col) const noexcept
+		{ return reinterpret_cast<const char *>(toBlob(row, col)); }
+	inline std::string toString(size_t row, int col) const
+		{ return std::string(toText(row, col), columnBytes(row, col)); }
+
+	void clear() noexcept;
+
+private:
+	struct Cell
+	{
+		union
+		{
+			sqlite3_int64 i;
+			double d;
+			size_t offset;
+		} value;
+		uint32_t size;
+		int32_t type;
+	};
+
+	std::vector<Cell> m_Cells;
+	std::vector<char> m_Bytes;
+	std::vector<std::string> m_ColumnNames;
+	std::unordered_map<std::string, int> m_ColumnIndices;
+	size_t m_NumRows;
+	int m_NumColumns;
+
+	inline const Cell & cell(size_t row, int col) const noexcept
+		{ return m_Cells[row * size_t(m_NumColumns) + size_t(col)]; }
+
+	void init(sqlite3_stmt * stmt);
+	void append(sqlite3_stmt * stmt);
+
+	SQLiteResultSet(const SQLiteResultSet &) = delete;
+	SQLiteResultSet & operator=(const SQLiteResultSet &) = delete;
+
+	friend class SQLiteDatabase;
+};
+
+#endif
@@ -0,0 +1,55 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __32fa45a439764213a83151100bf0629d__
+#define __32fa45a439764213a83151100bf0629d__
+
+#include "sqlite_result_set.h"
+#include <yip-imports/sqlite3.h>
+#include <cstdint>
+
+// Reusable buffer holding copies of a number of rows fetched under a single database lock.
+// Text and blob values are valid until the next batch is fetched into the buffer.
+class SQLiteRowBatch : public SQLiteResultSet
+{
+public:
+	struct FetchStats
+	{
+		size_t numRows;
+		size_t numBatches;
+		size_t lockAcquisitions;
+		size_t lockAcquisitionsSaved;    // Compared to releasing the lock for every row
+		uint64_t lockWaitMicroseconds;
+		uint64_t lockHoldMicroseconds;
+		uint64_t estimatedMicrosecondsSaved;    // Average lock wait multiplied by the number of saved acquisitions
+	};
+
+	enum
+	{
+		MinAdaptiveBatchSize = 16,
+		InitialAdaptiveBatchSize = 64,
+		MaxAdaptiveBatchSize = 4096,
+		AdaptiveTargetHoldMicroseconds = 1000,
+	};
+};
+
+#endif
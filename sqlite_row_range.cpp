@@ -0,0 +1,87 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_row_range.h"
+#include "sqlite_database.h"
+#include <yip-imports/cxx-util/macros.h>
+
+SQLiteRowRange::SQLiteRowRange(sqlite3_stmt * stmt) noexcept
+	: m_Handle(stmt),
+	  m_Cursor(stmt),
+	  m_Started(false),
+	  m_Done(false)
+{
+}
+
+SQLiteRowRange::SQLiteRowRange(SQLiteRowRange && other) noexcept
+	: m_Handle(other.m_Handle),
+	  m_Cursor(other.m_Handle),
+	  m_Started(other.m_Started),
+	  m_Done(other.m_Done)
+{
+	other.m_Handle = nullptr;
+	other.m_Done = true;
+}
+
+SQLiteRowRange::~SQLiteRowRange() noexcept
+{
+	if (m_Handle && m_Started)
+	{
+		SQLiteDatabase::Locker locker(m_Handle);
+		sqlite3_reset(m_Handle);
+	}
+}
+
+SQLiteRowRange::Iterator SQLiteRowRange::begin()
+{
+	if (!m_Started)
+	{
+		m_Started = true;
+
+		SQLiteDatabase::Locker locker(m_Handle);
+		sqlite3_reset(m_Handle);
+		locker.unlock();
+
+		if (!step())
+			return end();
+	}
+
+	return (m_Done ? end() : Iterator(this));
+}
+
+bool SQLiteRowRange::step()
+{
+	if (m_Done)
+		return false;
+
+	SQLiteDatabase::Locker locker(m_Handle);
+
+	int err = sqlite3_step(m_Handle);
+	if (LIKELY(err == SQLITE_ROW))
+		return true;
+
+	m_Done = true;
+	if (UNLIKELY(err != SQLITE_DONE))
+		SQLiteDatabase::throwExecError(m_Handle);
+
+	return false;
+}
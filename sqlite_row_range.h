@@ -0,0 +1,89 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __8a30caf49b96c0e7d96ce9a9db1f839b__
+#define __8a30caf49b96c0e7d96ce9a9db1f839b__
+
+#include "sqlite_cursor.h"
+#include <yip-imports/sqlite3.h>
+#include <iterator>
+#include <cstddef>
+
+// Pull-style range over rows of a statement. The statement is stepped lazily as the iterator is advanced and
+// is reset when the range is destroyed, so it is safe to break out of the loop early:
+//
+//   for (const SQLiteCursor & row : stmt.rows())
+//       ...
+class SQLiteRowRange
+{
+public:
+	class Iterator
+	{
+	public:
+		typedef std::input_iterator_tag iterator_category;
+		typedef SQLiteCursor value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const SQLiteCursor * pointer;
+		typedef const SQLiteCursor & reference;
+
+		inline Iterator() noexcept : m_Range(nullptr) {}
+
+		inline reference operator*() const noexcept { return m_Range->m_Cursor; }
+		inline pointer operator->() const noexcept { return &m_Range->m_Cursor; }
+
+		inline Iterator & operator++() { if (!m_Range->step()) m_Range = nullptr; return *this; }
+		inline Iterator operator++(int) { Iterator it(*this); ++*this; return it; }
+
+		inline bool operator==(const Iterator & other) const noexcept { return m_Range == other.m_Range; }
+		inline bool operator!=(const Iterator & other) const noexcept { return m_Range != other.m_Range; }
+
+	private:
+		SQLiteRowRange * m_Range;
+
+		inline explicit Iterator(SQLiteRowRange * range) noexcept : m_Range(range) {}
+
+		friend class SQLiteRowRange;
+	};
+
+	SQLiteRowRange(SQLiteRowRange && other) noexcept;
+	~SQLiteRowRange() noexcept;
+
+	Iterator begin();
+	inline Iterator end() const noexcept { return Iterator(); }
+
+private:
+	sqlite3_stmt * m_Handle;
+	SQLiteCursor m_Cursor;
+	bool m_Started;
+	bool m_Done;
+
+	explicit SQLiteRowRange(sqlite3_stmt * stmt) noexcept;
+
+	bool step();
+
+	SQLiteRowRange(const SQLiteRowRange &) = delete;
+	SQLiteRowRange & operator=(const SQLiteRowRange &) = delete;
+
+	friend class SQLiteStatement;
+};
+
+#endif
@@ -0,0 +1,196 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_slow_query_log.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <stdexcept>
+#include <cstring>
+
+namespace
+{
+	inline bool startsWith(const std::string & str, const char * prefix) noexcept
+	{
+		return str.compare(0, strlen(prefix), prefix) == 0;
+	}
+}
+
+SQLiteSlowQueryLog::SQLiteSlowQueryLog(uint64_t thresholdMicroseconds, size_t capacity)
+	: m_Capacity(capacity),
+	  m_ThresholdMicroseconds(thresholdMicroseconds)
+{
+	if (UNLIKELY(capacity == 0))
+		throw std::runtime_error("capacity of the slow query log should not be zero.");
+}
+
+SQLiteSlowQueryLog::~SQLiteSlowQueryLog()
+{
+}
+
+uint64_t SQLiteSlowQueryLog::thresholdMicroseconds() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_ThresholdMicroseconds;
+}
+
+void SQLiteSlowQueryLog::setThresholdMicroseconds(uint64_t threshold)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_ThresholdMicroseconds = threshold;
+}
+
+void SQLiteSlowQueryLog::setSink(const Sink & sink)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Sink = sink;
+}
+
+std::vector<SQLiteSlowQueryLog::Entry> SQLiteSlowQueryLog::entries() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return std::vector<Entry>(m_Entries.begin(), m_Entries.end());
+}
+
+void SQLiteSlowQueryLog::clear()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Entries.clear();
+}
+
+void SQLiteSlowQueryLog::check(sqlite3_stmt * stmt, uint64_t durationMicroseconds)
+{
+	Sink sink;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (LIKELY(durationMicroseconds < m_ThresholdMicroseconds))
+			return;
+		sink = m_Sink;
+	}
+
+	Entry entry;
+	entry.durationMicroseconds = durationMicroseconds;
+	entry.time = std::chrono::system_clock::now();
+	entry.fullTableScan = false;
+	entry.tempBTree = false;
+	entry.automaticIndex = false;
+
+	const char * sql = sqlite3_sql(stmt);
+	entry.sql = (sql ? sql : "");
+
+	char * expanded = sqlite3_expanded_sql(stmt);
+	if (expanded)
+	{
+		entry.expandedSQL = expanded;
+		sqlite3_free(expanded);
+	}
+
+	int numParameters = sqlite3_bind_parameter_count(stmt);
+	entry.parameters.reserve(size_t(numParameters));
+	for (int i = 1; i <= numParameters; i++)
+	{
+		const char * name = sqlite3_bind_parameter_name(stmt, i);
+		entry.parameters.emplace_back(name ? name : "");
+	}
+
+	// Plan might depend on values of parameters, so expanded SQL is preferred
+	if (!sqlite3_stmt_isexplain(stmt))
+	{
+		if (entry.expandedSQL.empty())
+			explain(stmt, entry.sql, entry);
+		else
+		{
+			explain(stmt, entry.expandedSQL, entry);
+			if (entry.plan.empty())
+				explain(stmt, entry.sql, entry);
+		}
+	}
+
+	for (const PlanStep & step : entry.plan)
+	{
+		if (startsWith(step.detail, "SCAN ") && step.detail.find(" INDEX ") == std::string::npos
+				&& !startsWith(step.detail, "SCAN CONSTANT ROW"))
+			entry.fullTableScan = true;
+		if (step.detail.find("TEMP B-TREE") != std::string::npos)
+			entry.tempBTree = true;
+		if (step.detail.find("AUTOMATIC") != std::string::npos)
+			entry.automaticIndex = true;
+	}
+
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+	for (int i = 0; ; i++)
+	{
+		sqlite3_int64 loops = 0, visits = 0;
+		double estimatedRows = 0.0;
+		const char * name = nullptr;
+		const char * explain = nullptr;
+
+		if (sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_NLOOP, &loops) != 0)
+			break;
+		sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_NVISIT, &visits);
+		sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_EST, &estimatedRows);
+		sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_NAME, &name);
+		sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_EXPLAIN, &explain);
+
+		ScanStatus scan;
+		scan.name = (name ? name : "");
+		scan.explain = (explain ? explain : "");
+		scan.loops = loops;
+		scan.visits = visits;
+		scan.estimatedRows = estimatedRows;
+		entry.scans.emplace_back(std::move(scan));
+	}
+#endif
+
+	if (sink)
+		sink(entry);
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_Entries.size() >= m_Capacity)
+		m_Entries.pop_front();
+	m_Entries.emplace_back(std::move(entry));
+}
+
+void SQLiteSlowQueryLog::explain(sqlite3_stmt * stmt, const std::string & sql, Entry & entry)
+{
+	std::string query = "EXPLAIN QUERY PLAN ";
+	query += sql;
+
+	sqlite3_stmt * plan = nullptr;
+	if (sqlite3_prepare_v2(sqlite3_db_handle(stmt), query.c_str(), int(query.length()), &plan, nullptr) != SQLITE_OK)
+	{
+		sqlite3_finalize(plan);
+		return;
+	}
+
+	// Columns are (id, parent, notused, detail)
+	int detailColumn = sqlite3_column_count(plan) - 1;
+	while (sqlite3_step(plan) == SQLITE_ROW)
+	{
+		PlanStep step;
+		step.id = sqlite3_column_int(plan, 0);
+		step.parent = sqlite3_column_int(plan, 1);
+		const unsigned char * detail = sqlite3_column_text(plan, detailColumn);
+		step.detail = (detail ? reinterpret_cast<const char *>(detail) : "");
+		entry.plan.emplace_back(std::move(step));
+	}
+
+	sqlite3_finalize(plan);
+}
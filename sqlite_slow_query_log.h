@@ -0,0 +1,105 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __caf14fd8d0843cf65c7c6f52a22ec97d__
+#define __caf14fd8d0843cf65c7c6f52a22ec97d__
+
+#include <yip-imports/sqlite3.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// Records statements that took longer than the threshold to execute, together with their query plans. Attach it
+// to a database with `SQLiteDatabase::setSlowQueryLog`. Entries are kept in a ring buffer of fixed capacity and
+// are optionally passed to a sink callback (which is invoked with the database locked).
+class SQLiteSlowQueryLog
+{
+public:
+	enum { DefaultCapacity = 128 };
+
+	struct PlanStep
+	{
+		int id;
+		int parent;
+		std::string detail;
+	};
+
+	// Available only when SQLite is compiled with SQLITE_ENABLE_STMT_SCANSTATUS. Counters are accumulated
+	// over all executions of the statement.
+	struct ScanStatus
+	{
+		std::string name;
+		std::string explain;
+		int64_t loops;
+		int64_t visits;
+		double estimatedRows;
+	};
+
+	struct Entry
+	{
+		std::string sql;
+		std::string expandedSQL;                // SQL with values of bound parameters substituted
+		std::vector<std::string> parameters;    // Names of the parameters, empty for anonymous ones
+		uint64_t durationMicroseconds;          // Includes time spent in row callbacks
+		std::chrono::system_clock::time_point time;
+		std::vector<PlanStep> plan;
+		std::vector<ScanStatus> scans;
+		bool fullTableScan;
+		bool tempBTree;
+		bool automaticIndex;
+	};
+
+	typedef std::function<void(const Entry & entry)> Sink;
+
+	SQLiteSlowQueryLog(uint64_t thresholdMicroseconds, size_t capacity = DefaultCapacity);
+	~SQLiteSlowQueryLog();
+
+	uint64_t thresholdMicroseconds() const;
+	void setThresholdMicroseconds(uint64_t threshold);
+
+	void setSink(const Sink & sink);
+
+	std::vector<Entry> entries() const;
+	void clear();
+
+private:
+	mutable std::mutex m_Mutex;
+	std::deque<Entry> m_Entries;
+	size_t m_Capacity;
+	uint64_t m_ThresholdMicroseconds;
+	Sink m_Sink;
+
+	void check(sqlite3_stmt * stmt, uint64_t durationMicroseconds);
+
+	static void explain(sqlite3_stmt * stmt, const std::string & sql, Entry & entry);
+
+	SQLiteSlowQueryLog(const SQLiteSlowQueryLog &) = delete;
+	SQLiteSlowQueryLog & operator=(const SQLiteSlowQueryLog &) = delete;
+
+	friend class SQLiteDatabase;
+};
+
+#endif
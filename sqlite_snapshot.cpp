@@ -0,0 +1,105 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_snapshot.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+
+SQLiteSnapshot::SQLiteSnapshot(SQLiteDatabase & db)
+	: m_Handle(nullptr)
+{
+	SQLiteDatabase::Locker locker(db);
+
+	int err;
+	if (!sqlite3_get_autocommit(db.handle()))
+		err = sqlite3_snapshot_get(db.handle(), "main", &m_Handle);
+	else
+	{
+		db.transaction([&db, &err, this]() {
+			err = sqlite3_snapshot_get(db.handle(), "main", &m_Handle);
+		}, SQLiteDatabase::DeferredTransaction);
+	}
+
+	if (UNLIKELY(err != SQLITE_OK))
+	{
+		m_Handle = nullptr;
+		throw std::runtime_error(fmt() << "unable to capture snapshot of database '" << db.fileName()
+			<< "': " << sqlite3_errmsg(db.handle()));
+	}
+}
+
+SQLiteSnapshot::~SQLiteSnapshot()
+{
+	if (m_Handle)
+		sqlite3_snapshot_free(m_Handle);
+}
+
+SQLiteSnapshot & SQLiteSnapshot::operator=(SQLiteSnapshot && other) noexcept
+{
+	if (this != &other)
+	{
+		if (m_Handle)
+			sqlite3_snapshot_free(m_Handle);
+		m_Handle = other.m_Handle;
+		other.m_Handle = nullptr;
+	}
+	return *this;
+}
+
+int SQLiteSnapshot::compare(const SQLiteSnapshot & other) const
+{
+	if (UNLIKELY(!m_Handle || !other.m_Handle))
+		throw std::runtime_error("attempted to compare an empty snapshot.");
+	return sqlite3_snapshot_cmp(m_Handle, other.m_Handle);
+}
+
+void SQLiteSnapshot::read(SQLiteDatabase & db, const std::function<void()> & code) const
+{
+	if (UNLIKELY(!m_Handle))
+		throw std::runtime_error("attempted to read from an empty snapshot.");
+
+	db.transaction([&db, &code, this]() {
+		// Connection might not know yet that the database is in WAL mode. Reading the header opens a read
+		// transaction, which is then moved to the snapshot.
+		db.exec("PRAGMA application_id");
+
+		int err = sqlite3_snapshot_open(db.handle(), "main", m_Handle);
+		if (UNLIKELY(err != SQLITE_OK))
+		{
+			if (err == SQLITE_ERROR_SNAPSHOT)
+			{
+				throw std::runtime_error(fmt() << "snapshot of database '" << db.fileName()
+					<< "' has been overwritten by a checkpoint.");
+			}
+			throw std::runtime_error(fmt() << "unable to open snapshot of database '" << db.fileName()
+				<< "': " << sqlite3_errmsg(db.handle()));
+		}
+
+		if (LIKELY(code))
+			code();
+	}, SQLiteDatabase::DeferredTransaction);
+}
+
+#endif
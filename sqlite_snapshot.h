@@ -0,0 +1,68 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __bc390e16b36e03ae930a5cc9497ef851__
+#define __bc390e16b36e03ae930a5cc9497ef851__
+
+#include "sqlite_database.h"
+#include <functional>
+
+#ifdef SQLITE_ENABLE_SNAPSHOT
+
+// Point-in-time state of a WAL mode database. Read transactions can be opened at this exact state on any
+// number of other connections to the same file, so that several queries see consistent data without keeping
+// the writer blocked.
+//
+// Snapshot becomes invalid when a checkpoint overwrites it; keep a read transaction open somewhere (see
+// `SQLiteConnectionPool::withSnapshot`) for as long as the snapshot is in use.
+class SQLiteSnapshot
+{
+public:
+	// Captures the current state of the main schema of `db`. If `db` is in autocommit mode, a short read
+	// transaction is opened for the capture. Fails if `db` has an open write transaction or if nothing was
+	// written to the WAL file since it has been created.
+	explicit SQLiteSnapshot(SQLiteDatabase & db);
+	inline SQLiteSnapshot(SQLiteSnapshot && other) noexcept : m_Handle(other.m_Handle) { other.m_Handle = nullptr; }
+	~SQLiteSnapshot();
+
+	SQLiteSnapshot & operator=(SQLiteSnapshot && other) noexcept;
+
+	inline sqlite3_snapshot * handle() const noexcept { return m_Handle; }
+
+	// Returns negative value if this snapshot is older than `other`, positive if newer and zero if both refer
+	// to the same state. Both snapshots should have been captured on the same database file.
+	int compare(const SQLiteSnapshot & other) const;
+
+	// Runs `code` in a read transaction on `db` opened at this snapshot. Should not be called while `db`
+	// is inside another transaction.
+	void read(SQLiteDatabase & db, const std::function<void()> & code) const;
+
+private:
+	sqlite3_snapshot * m_Handle;
+
+	SQLiteSnapshot(const SQLiteSnapshot &) = delete;
+	SQLiteSnapshot & operator=(const SQLiteSnapshot &) = delete;
+};
+
+#endif
+
+#endif
@@ -22,27 +22,32 @@
 //
 #include "sqlite_statement.h"
 #include "sqlite_database.h"
+#include "sqlite_clock.h"
 #include <yip-imports/cxx-util/macros.h>
 #include <yip-imports/cxx-util/fmt.h>
 #include <stdexcept>
+#include <chrono>
 
 SQLiteStatement::SQLiteStatement(SQLiteDatabase & database, const char * sql)
-	: m_Handle(nullptr)
+	: m_Database(database),
+	  m_Handle(nullptr)
 {
 	SQLiteDatabase::Locker locker(database);
-	database.prepare(locker, m_Handle, sql);
+	m_Handle = database.m_StatementCache.acquire(database.m_Handle, sql);
 }
 
 SQLiteStatement::SQLiteStatement(SQLiteDatabase & database, const std::string & sql)
-	: m_Handle(nullptr)
+	: m_Database(database),
+	  m_Handle(nullptr)
 {
 	SQLiteDatabase::Locker locker(database);
-	database.prepare(locker, m_Handle, sql.c_str());
+	m_Handle = database.m_StatementCache.acquire(database.m_Handle, sql.c_str());
 }
 
 SQLiteStatement::~SQLiteStatement() noexcept
 {
-	sqlite3_finalize(m_Handle);
+	SQLiteDatabase::Locker locker(m_Database);
+	m_Database.m_StatementCache.release(m_Handle);
 }
 
 void SQLiteStatement::bindNull(int index) const
@@ -100,6 +105,52 @@ void SQLiteStatement::bindBlob(int index, const void * data, size_t size, void (
 	checkError(sqlite3_bind_blob(m_Handle, index, data, static_cast<int>(size), destructor), index);
 }
 
+void SQLiteStatement::bindZeroBlob(int index, sqlite3_uint64 size) const
+{
+	checkError(sqlite3_bind_zeroblob64(m_Handle, index, size), index);
+}
+
+void SQLiteStatement::bindStaticText(int index, const char * text, size_t length) const
+{
+	checkError(sqlite3_bind_text(m_Handle, index, text, static_cast<int>(length), SQLITE_STATIC), index);
+}
+
+void SQLiteStatement::bindStaticBlob(int index, const void * data, size_t size) const
+{
+	checkError(sqlite3_bind_blob(m_Handle, index, data, static_cast<int>(size), SQLITE_STATIC), index);
+}
+
+void SQLiteStatement::bindPinnedText(int index, const char * text, size_t length,
+	std::shared_ptr<const void> owner) const
+{
+	bindStaticText(index, text, length);
+	pin(index, std::move(owner));
+}
+
+void SQLiteStatement::bindPinnedBlob(int index, const void * data, size_t size,
+	std::shared_ptr<const void> owner) const
+{
+	bindStaticBlob(index, data, size);
+	pin(index, std::move(owner));
+}
+
+void SQLiteStatement::bindPinnedString(int index, const std::shared_ptr<const std::string> & string) const
+{
+	bindPinnedText(index, string->data(), string->length(), string);
+}
+
+void SQLiteStatement::clearBindings() const
+{
+	SQLiteDatabase::Locker locker(m_Database);
+	clearBindingsLocked();
+}
+
+void SQLiteStatement::clearBindingsLocked() const noexcept
+{
+	sqlite3_clear_bindings(m_Handle);
+	m_PinnedBuffers.clear();
+}
+
 int SQLiteStatement::parameterIndex(const char * name) const
 {
 	int index = sqlite3_bind_parameter_index(m_Handle, name);
@@ -128,20 +179,98 @@ int SQLiteStatement::parameterIndex(const std::string & name, const std::nothrow
 
 void SQLiteStatement::exec() const
 {
-	SQLiteDatabase::Locker locker(m_Handle);
+	SQLiteDatabase::Locker locker(m_Database);
 	SQLiteDatabase::exec(locker, m_Handle);
 }
 
 void SQLiteStatement::exec(const std::function<void(const SQLiteCursor &)> & onRow) const
 {
-	SQLiteDatabase::Locker locker(m_Handle);
-	SQLiteDatabase::exec(locker, m_Handle, [&onRow, this](){ onRow(SQLiteCursor(m_Handle)); });
+	execRows(SQLiteDatabase::NoLimit, onRow);
 }
 
 void SQLiteStatement::exec(const std::function<void(const SQLiteCursor &)> & onRow, size_t limit) const
 {
-	SQLiteDatabase::Locker locker(m_Handle);
-	SQLiteDatabase::exec(locker, m_Handle, [&onRow, this](){ onRow(SQLiteCursor(m_Handle)); }, limit);
+	execRows(limit, onRow);
+}
+
+void SQLiteStatement::exec(SQLiteResultSet & result) const
+{
+	SQLiteDatabase::Locker locker(m_Database);
+	SQLiteDatabase::exec(locker, m_Handle, result);
+}
+
+SQLiteRowBatch::FetchStats SQLiteStatement::fetchBatches(const SQLiteDatabase::BatchCallback & onBatch,
+	size_t batchSize) const
+{
+	SQLiteDatabase::Locker locker(m_Database);
+	return SQLiteDatabase::fetchBatches(locker, m_Handle, batchSize, onBatch);
+}
+
+SQLiteStatement::BatchResult SQLiteStatement::execBatch(const BatchRowProducer & bindNextRow, size_t commitSize,
+	const BatchChunkCallback & onChunk) const
+{
+	typedef std::chrono::steady_clock clock;
+
+	BatchResult result;
+	result.numRows = 0;
+	result.numChunks = 0;
+	result.microseconds = 0;
+
+	if (commitSize == 0)
+		commitSize = 1;
+
+	SQLiteDatabase::Locker locker(m_Database);
+	sqlite3_reset(m_Handle);
+	clearBindingsLocked();
+
+	clock::time_point batchStart = clock::now();
+	bool hasMoreRows = true;
+	while (hasMoreRows)
+	{
+		BatchChunk chunk;
+		chunk.index = result.numChunks;
+		chunk.firstRow = result.numRows;
+		chunk.numRows = 0;
+
+		clock::time_point chunkStart = clock::now();
+		m_Database.begin(locker);
+		try
+		{
+			while (chunk.numRows < commitSize)
+			{
+				if (!bindNextRow(*this))
+				{
+					hasMoreRows = false;
+					break;
+				}
+
+				SQLiteDatabase::exec(locker, m_Handle);
+				clearBindingsLocked();
+				++chunk.numRows;
+			}
+		}
+		catch (...)
+		{
+			clearBindingsLocked();
+			m_Database.rollback(locker);
+			throw;
+		}
+		m_Database.commit(locker);
+
+		if (chunk.numRows == 0)
+			break;
+
+		chunk.microseconds = SQLiteMicrosecondsSince(chunkStart);
+		result.numRows += chunk.numRows;
+		++result.numChunks;
+
+		if (onChunk)
+			onChunk(chunk);
+	}
+
+	result.microseconds = SQLiteMicrosecondsSince(batchStart);
+
+	return result;
 }
 
 void SQLiteStatement::checkError(int err, int index) const
@@ -152,3 +281,11 @@ void SQLiteStatement::checkError(int err, int index) const
 			<< sqlite3_sql(m_Handle) << "': " << sqlite3_errstr(err));
 	}
 }
+
+void SQLiteStatement::pin(int index, std::shared_ptr<const void> && owner) const
+{
+	size_t slot = static_cast<size_t>(index);
+	if (m_PinnedBuffers.size() <= slot)
+		m_PinnedBuffers.resize(slot + 1);
+	m_PinnedBuffers[slot] = std::move(owner);
+}
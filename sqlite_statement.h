@@ -23,16 +23,49 @@
 #ifndef __3e320ef32f5d788aaaff81904c4932cf__
 #define __3e320ef32f5d788aaaff81904c4932cf__
 
+#include "sqlite_database.h"
 #include "sqlite_cursor.h"
+#include "sqlite_row_range.h"
+#include "sqlite_traits.h"
 #include <yip-imports/sqlite3.h>
 #include <string>
+#include <tuple>
+#include <vector>
+#include <memory>
 #include <functional>
 
-class SQLiteDatabase;
+#if __cplusplus >= 201703L
+ #include <string_view>
+#endif
 
+// Prepared statement. The handle is taken from the statement cache of the database and returned to it in the
+// destructor, so the statement should be destroyed before its database.
 class SQLiteStatement
 {
 public:
+	enum { DefaultBatchCommitSize = 10000 };
+
+	struct BatchChunk
+	{
+		size_t index;
+		size_t firstRow;
+		size_t numRows;
+		uint64_t microseconds;
+	};
+
+	struct BatchResult
+	{
+		size_t numRows;
+		size_t numChunks;
+		uint64_t microseconds;
+
+		inline double rowsPerSecond() const noexcept
+			{ return microseconds > 0 ? double(numRows) * 1000000.0 / double(microseconds) : 0.0; }
+	};
+
+	typedef std::function<bool(const SQLiteStatement & stmt)> BatchRowProducer;
+	typedef std::function<void(const BatchChunk & chunk)> BatchChunkCallback;
+
 	SQLiteStatement(SQLiteDatabase & database, const char * sql);
 	SQLiteStatement(SQLiteDatabase & database, const std::string & sql);
 	~SQLiteStatement() noexcept;
@@ -51,6 +84,33 @@ public:
 	void bindString(int index, const std::string & string) const;
 	void bindBlob(int index, const void * data, size_t size, void (* destructor)(void *) = SQLITE_TRANSIENT) const;
 
+	// Binds a blob of `size` zero bytes without allocating it; use SQLiteBlob to fill it in place.
+	void bindZeroBlob(int index, sqlite3_uint64 size) const;
+
+	// Binds without copying the data (SQLITE_STATIC). Caller should keep the buffer alive and unmodified
+	// until the parameter is re-bound, bindings are cleared or the statement is destroyed.
+	void bindStaticText(int index, const char * text, size_t length) const;
+	void bindStaticBlob(int index, const void * data, size_t size) const;
+#if __cplusplus >= 201703L
+	inline void bindStaticText(int index, std::string_view text) const
+		{ bindStaticText(index, text.data(), text.size()); }
+#endif
+
+	// Binds without copying the data and keeps `owner` alive until the parameter is re-bound, bindings are
+	// cleared or the statement is destroyed.
+	void bindPinnedText(int index, const char * text, size_t length, std::shared_ptr<const void> owner) const;
+	void bindPinnedBlob(int index, const void * data, size_t size, std::shared_ptr<const void> owner) const;
+	void bindPinnedString(int index, const std::shared_ptr<const std::string> & string) const;
+
+	void clearBindings() const;
+
+	// Binds value using the SQLiteTraits specialization for its type.
+	template <class T> inline void bindValue(int index, const T & value) const
+		{ checkError(SQLiteTraits<typename std::decay<T>::type>::bind(m_Handle, index, value), index); }
+
+	// Binds arguments to parameters 1..N.
+	template <class... ARGS> inline void bindAll(const ARGS &... args) const { bindFrom(1, args...); }
+
 	int parameterIndex(const char * name) const;
 	int parameterIndex(const std::string & name) const;
 
@@ -61,10 +121,66 @@ public:
 	void exec(const std::function<void(const SQLiteCursor & cursor)> & onRow) const;
 	void exec(const std::function<void(const SQLiteCursor & cursor)> & onRow, size_t limit) const;
 
+	// Materializes all rows returned by the statement into the result set.
+	void exec(SQLiteResultSet & result) const;
+
+	// Overloads accepting any callable with signature `void(const SQLiteCursor &)`. The row loop is
+	// instantiated for the callable type, so the callback could be inlined.
+	template <class FUNC> inline void exec(FUNC && onRow) const { execRows(SQLiteDatabase::NoLimit, onRow); }
+	template <class FUNC> inline void exec(FUNC && onRow, size_t limit) const { execRows(limit, onRow); }
+
+	// Fetches rows in batches, see SQLiteDatabase::fetchBatches.
+	SQLiteRowBatch::FetchStats fetchBatches(const SQLiteDatabase::BatchCallback & onBatch,
+		size_t batchSize = 0) const;
+
+	// Returns range for pulling rows with iterators. The statement is reset when the range is destroyed.
+	inline SQLiteRowRange rows() const noexcept { return SQLiteRowRange(m_Handle); }
+
+	// Executes the statement for each row of parameters. `bindNextRow` should bind parameters for the next
+	// row and return `true`, or return `false` when there are no more rows. Rows are executed inside of
+	// transactions of `commitSize` rows each; if execution fails, only the current chunk is rolled back.
+	// Database lock is held for the whole batch, so `bindNextRow` and `onChunk` should not block.
+	BatchResult execBatch(const BatchRowProducer & bindNextRow, size_t commitSize = DefaultBatchCommitSize,
+		const BatchChunkCallback & onChunk = nullptr) const;
+
+	// Executes the statement for each tuple in the range. Tuple elements are bound to parameters 1..N.
+	template <class ITER> BatchResult execBatch(ITER begin, ITER end,
+		size_t commitSize = DefaultBatchCommitSize, const BatchChunkCallback & onChunk = nullptr) const
+	{
+		return execBatch([&begin, end](const SQLiteStatement & stmt) -> bool {
+			if (begin == end)
+				return false;
+			stmt.bindTuple(*begin);
+			++begin;
+			return true;
+		}, commitSize, onChunk);
+	}
+
 private:
+	SQLiteDatabase & m_Database;
 	sqlite3_stmt * m_Handle;
+	mutable std::vector<std::shared_ptr<const void>> m_PinnedBuffers;
 
 	void checkError(int err, int index) const;
+	void pin(int index, std::shared_ptr<const void> && owner) const;
+
+	// Same as `clearBindings`, for callers that already hold the database lock.
+	void clearBindingsLocked() const noexcept;
+
+	template <class FUNC> inline void execRows(size_t limit, FUNC & onRow) const
+	{
+		SQLiteDatabase::Locker locker(m_Database);
+		SQLiteDatabase::execRows(locker, m_Handle, limit, [&onRow, this](){ onRow(SQLiteCursor(m_Handle)); });
+	}
+
+	inline void bindFrom(int) const {}
+	template <class T, class... ARGS> inline void bindFrom(int index, const T & value, const ARGS &... args) const
+		{ bindValue(index, value); bindFrom(index + 1, args...); }
+
+	template <class TUPLE, size_t... N> inline void bindTuple(const TUPLE & tuple, SQLiteIndices<N...>) const
+		{ bindAll(std::get<N>(tuple)...); }
+	template <class... ARGS> inline void bindTuple(const std::tuple<ARGS...> & tuple) const
+		{ bindTuple(tuple, typename SQLiteMakeIndices<sizeof...(ARGS)>::Type()); }
 
 	SQLiteStatement(const SQLiteStatement &) = delete;
 	SQLiteStatement & operator=(const SQLiteStatement &) = delete;
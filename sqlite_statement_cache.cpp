@@ -0,0 +1,181 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_statement_cache.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+
+SQLiteStatementCache::SQLiteStatementCache(size_t capacity) noexcept
+	: m_Capacity(capacity),
+	  m_NumInUse(0)
+{
+	resetStats();
+}
+
+SQLiteStatementCache::~SQLiteStatementCache() noexcept
+{
+	flush();
+}
+
+void SQLiteStatementCache::setCapacity(size_t capacity) noexcept
+{
+	m_Capacity = capacity;
+	trim();
+}
+
+void SQLiteStatementCache::resetStats() noexcept
+{
+	m_Stats.hits = 0;
+	m_Stats.misses = 0;
+	m_Stats.evictions = 0;
+}
+
+sqlite3_stmt * SQLiteStatementCache::acquire(sqlite3 * db, const char * sql)
+{
+	std::string key(sql);
+
+	auto it = m_BySQL.find(key);
+	if (it != m_BySQL.end())
+	{
+		EntryList::iterator entry = it->second;
+		if (LIKELY(!entry->inUse))
+		{
+			++m_Stats.hits;
+			entry->inUse = true;
+			m_Entries.splice(m_Entries.begin(), m_Entries, entry);
+			++m_NumInUse;
+			return entry->stmt;
+		}
+
+		++m_Stats.misses;
+		sqlite3_stmt * stmt = prepare(db, sql);
+		++m_NumInUse;
+		return stmt;
+	}
+
+	++m_Stats.misses;
+	sqlite3_stmt * stmt = prepare(db, sql);
+	if (m_Capacity == 0)
+	{
+		++m_NumInUse;
+		return stmt;
+	}
+
+	try
+	{
+		m_Entries.push_front(Entry());
+		Entry & entry = m_Entries.front();
+		entry.sql = std::move(key);
+		entry.stmt = stmt;
+		entry.inUse = true;
+		m_BySQL[entry.sql] = m_Entries.begin();
+		m_ByHandle[stmt] = m_Entries.begin();
+	}
+	catch (...)
+	{
+		if (!m_Entries.empty() && m_Entries.front().stmt == stmt)
+			erase(m_Entries.begin());
+		sqlite3_finalize(stmt);
+		throw;
+	}
+
+	trim();
+
+	++m_NumInUse;
+	return stmt;
+}
+
+void SQLiteStatementCache::release(sqlite3_stmt * stmt, bool discard) noexcept
+{
+	if (!stmt)
+		return;
+
+	--m_NumInUse;
+
+	auto it = m_ByHandle.find(stmt);
+	if (it == m_ByHandle.end())
+	{
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	if (UNLIKELY(discard))
+	{
+		erase(it->second);
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	it->second->inUse = false;
+
+	trim();
+}
+
+void SQLiteStatementCache::flush() noexcept
+{
+	for (auto it = m_Entries.begin(); it != m_Entries.end(); )
+	{
+		auto cur = it++;
+		if (!cur->inUse)
+			sqlite3_finalize(cur->stmt);
+		erase(cur);
+	}
+}
+
+void SQLiteStatementCache::erase(EntryList::iterator it) noexcept
+{
+	m_BySQL.erase(it->sql);
+	m_ByHandle.erase(it->stmt);
+	m_Entries.erase(it);
+}
+
+void SQLiteStatementCache::trim() noexcept
+{
+	auto it = m_Entries.end();
+	while (m_Entries.size() > m_Capacity && it != m_Entries.begin())
+	{
+		auto cur = --it;
+		if (cur->inUse)
+			continue;
+
+		++it;
+		sqlite3_finalize(cur->stmt);
+		erase(cur);
+		++m_Stats.evictions;
+	}
+}
+
+sqlite3_stmt * SQLiteStatementCache::prepare(sqlite3 * db, const char * sql)
+{
+	sqlite3_stmt * stmt = nullptr;
+	int err = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+	if (UNLIKELY(err != SQLITE_OK || !stmt))
+	{
+		sqlite3_finalize(stmt);
+		throw std::runtime_error(fmt()
+			<< "unable to prepare statement '" << sql << "': " << sqlite3_errmsg(db));
+	}
+	return stmt;
+}
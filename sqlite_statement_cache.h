@@ -0,0 +1,97 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __ce60c59fa7dcdadc2b3ac0bbfe070ab1__
+#define __ce60c59fa7dcdadc2b3ac0bbfe070ab1__
+
+#include <yip-imports/sqlite3.h>
+#include <unordered_map>
+#include <string>
+#include <list>
+
+// LRU cache of prepared statements keyed by the SQL text.
+// This class is not thread safe: all calls should be made while holding the database mutex.
+class SQLiteStatementCache
+{
+public:
+	enum { DefaultCapacity = 64 };
+
+	struct Stats
+	{
+		size_t hits;
+		size_t misses;
+		size_t evictions;
+	};
+
+	SQLiteStatementCache(size_t capacity = DefaultCapacity) noexcept;
+	~SQLiteStatementCache() noexcept;
+
+	inline size_t capacity() const noexcept { return m_Capacity; }
+	void setCapacity(size_t capacity) noexcept;
+
+	inline size_t size() const noexcept { return m_Entries.size(); }
+
+	// Number of statements acquired and not released yet, including the uncached ones.
+	inline size_t numInUse() const noexcept { return m_NumInUse; }
+
+	inline const Stats & stats() const noexcept { return m_Stats; }
+	void resetStats() noexcept;
+
+	// Returns statement for the given SQL. If cached statement is currently in use (e.g. the same query is
+	// executed re-entrantly from the row callback), a new uncached statement is prepared.
+	sqlite3_stmt * acquire(sqlite3 * db, const char * sql);
+
+	// Resets the statement and returns it into the cache. If `discard` is true, statement is finalized
+	// (this should be done after execution errors, as statement could have been invalidated by schema change).
+	void release(sqlite3_stmt * stmt, bool discard = false) noexcept;
+
+	// Finalizes all idle statements. Statements currently in use are detached from the cache and will
+	// be finalized when released.
+	void flush() noexcept;
+
+private:
+	struct Entry
+	{
+		std::string sql;
+		sqlite3_stmt * stmt;
+		bool inUse;
+	};
+
+	typedef std::list<Entry> EntryList;
+
+	EntryList m_Entries;
+	std::unordered_map<std::string, EntryList::iterator> m_BySQL;
+	std::unordered_map<sqlite3_stmt *, EntryList::iterator> m_ByHandle;
+	size_t m_Capacity;
+	size_t m_NumInUse;
+	Stats m_Stats;
+
+	void erase(EntryList::iterator it) noexcept;
+	void trim() noexcept;
+
+	static sqlite3_stmt * prepare(sqlite3 * db, const char * sql);
+
+	SQLiteStatementCache(const SQLiteStatementCache &) = delete;
+	SQLiteStatementCache & operator=(const SQLiteStatementCache &) = delete;
+};
+
+#endif
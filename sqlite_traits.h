@@ -0,0 +1,222 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __b7c0f4436b0737332bb2e62f0b27a052__
+#define __b7c0f4436b0737332bb2e62f0b27a052__
+
+#include <yip-imports/sqlite3.h>
+#include <type_traits>
+#include <cstddef>
+#include <string>
+
+#if __cplusplus >= 201703L
+ #include <string_view>
+ #include <optional>
+#endif
+
+// Compile-time mapping between C++ types and SQLite values, used by SQLiteStatement::bindAll,
+// SQLiteCursor::get and user-defined functions. User types could be supported by specializing this template
+// with the following static methods (only those needed by the caller are required):
+//   static int bind(sqlite3_stmt * stmt, int index, const T & value) noexcept; // returns SQLite error code
+//   static T column(sqlite3_stmt * stmt, int index) noexcept;
+//   static T value(sqlite3_value * value) noexcept;                            // function arguments
+//   static void result(sqlite3_context * context, const T & value) noexcept;   // function results
+template <class T, class ENABLE = void> struct SQLiteTraits;
+
+template <> struct SQLiteTraits<std::nullptr_t>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, std::nullptr_t) noexcept
+		{ return sqlite3_bind_null(stmt, index); }
+	static inline void result(sqlite3_context * context, std::nullptr_t) noexcept
+		{ sqlite3_result_null(context); }
+};
+
+template <> struct SQLiteTraits<bool>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, bool value) noexcept
+		{ return sqlite3_bind_int(stmt, index, value ? 1 : 0); }
+	static inline bool column(sqlite3_stmt * stmt, int index) noexcept
+		{ return sqlite3_column_int(stmt, index) != 0; }
+	static inline bool value(sqlite3_value * value) noexcept
+		{ return sqlite3_value_int(value) != 0; }
+	static inline void result(sqlite3_context * context, bool value) noexcept
+		{ sqlite3_result_int(context, value ? 1 : 0); }
+};
+
+// Integers that fit into `int` are bound with sqlite3_bind_int, all other integers with sqlite3_bind_int64.
+template <class T> struct SQLiteTraits<T, typename std::enable_if<std::is_integral<T>::value
+	&& !std::is_same<T, bool>::value && (sizeof(T) < sizeof(int)
+		|| (sizeof(T) == sizeof(int) && std::is_signed<T>::value))>::type>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, T value) noexcept
+		{ return sqlite3_bind_int(stmt, index, static_cast<int>(value)); }
+	static inline T column(sqlite3_stmt * stmt, int index) noexcept
+		{ return static_cast<T>(sqlite3_column_int(stmt, index)); }
+	static inline T value(sqlite3_value * value) noexcept
+		{ return static_cast<T>(sqlite3_value_int(value)); }
+	static inline void result(sqlite3_context * context, T value) noexcept
+		{ sqlite3_result_int(context, static_cast<int>(value)); }
+};
+
+template <class T> struct SQLiteTraits<T, typename std::enable_if<std::is_integral<T>::value
+	&& !std::is_same<T, bool>::value && (sizeof(T) > sizeof(int)
+		|| (sizeof(T) == sizeof(int) && !std::is_signed<T>::value))>::type>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, T value) noexcept
+		{ return sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(value)); }
+	static inline T column(sqlite3_stmt * stmt, int index) noexcept
+		{ return static_cast<T>(sqlite3_column_int64(stmt, index)); }
+	static inline T value(sqlite3_value * value) noexcept
+		{ return static_cast<T>(sqlite3_value_int64(value)); }
+	static inline void result(sqlite3_context * context, T value) noexcept
+		{ sqlite3_result_int64(context, static_cast<sqlite3_int64>(value)); }
+};
+
+template <class T> struct SQLiteTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, T value) noexcept
+		{ return sqlite3_bind_double(stmt, index, static_cast<double>(value)); }
+	static inline T column(sqlite3_stmt * stmt, int index) noexcept
+		{ return static_cast<T>(sqlite3_column_double(stmt, index)); }
+	static inline T value(sqlite3_value * value) noexcept
+		{ return static_cast<T>(sqlite3_value_double(value)); }
+	static inline void result(sqlite3_context * context, T value) noexcept
+		{ sqlite3_result_double(context, static_cast<double>(value)); }
+};
+
+template <class T> struct SQLiteTraits<T, typename std::enable_if<std::is_enum<T>::value>::type>
+{
+	typedef typename std::underlying_type<T>::type UnderlyingType;
+
+	static inline int bind(sqlite3_stmt * stmt, int index, T value) noexcept
+		{ return SQLiteTraits<UnderlyingType>::bind(stmt, index, static_cast<UnderlyingType>(value)); }
+	static inline T column(sqlite3_stmt * stmt, int index) noexcept
+		{ return static_cast<T>(SQLiteTraits<UnderlyingType>::column(stmt, index)); }
+	static inline T value(sqlite3_value * value) noexcept
+		{ return static_cast<T>(SQLiteTraits<UnderlyingType>::value(value)); }
+	static inline void result(sqlite3_context * context, T value) noexcept
+		{ SQLiteTraits<UnderlyingType>::result(context, static_cast<UnderlyingType>(value)); }
+};
+
+template <> struct SQLiteTraits<const char *>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, const char * value) noexcept
+		{ return sqlite3_bind_text(stmt, index, value, -1, SQLITE_TRANSIENT); }
+	static inline const char * column(sqlite3_stmt * stmt, int index) noexcept
+		{ return reinterpret_cast<const char *>(sqlite3_column_text(stmt, index)); }
+	static inline const char * value(sqlite3_value * value) noexcept
+		{ return reinterpret_cast<const char *>(sqlite3_value_text(value)); }
+	static inline void result(sqlite3_context * context, const char * value) noexcept
+	{
+		if (!value)
+			sqlite3_result_null(context);
+		else
+			sqlite3_result_text(context, value, -1, SQLITE_TRANSIENT);
+	}
+};
+
+template <> struct SQLiteTraits<std::string>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, const std::string & value) noexcept
+	{
+		return sqlite3_bind_text(stmt, index, value.data(), static_cast<int>(value.length()), SQLITE_TRANSIENT);
+	}
+
+	static inline std::string column(sqlite3_stmt * stmt, int index)
+	{
+		const char * text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, index));
+		return std::string(text ? text : "", static_cast<size_t>(sqlite3_column_bytes(stmt, index)));
+	}
+
+	static inline std::string value(sqlite3_value * value)
+	{
+		const char * text = reinterpret_cast<const char *>(sqlite3_value_text(value));
+		return std::string(text ? text : "", static_cast<size_t>(sqlite3_value_bytes(value)));
+	}
+
+	static inline void result(sqlite3_context * context, const std::string & value) noexcept
+		{ sqlite3_result_text(context, value.data(), static_cast<int>(value.length()), SQLITE_TRANSIENT); }
+};
+
+template <> struct SQLiteTraits<char *> : SQLiteTraits<const char *> {};
+
+#if __cplusplus >= 201703L
+
+// Views returned by `column` are valid until the next step or reset of the statement.
+template <> struct SQLiteTraits<std::string_view>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, std::string_view value) noexcept
+		{ return sqlite3_bind_text(stmt, index, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT); }
+
+	static inline std::string_view column(sqlite3_stmt * stmt, int index) noexcept
+	{
+		const char * text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, index));
+		return std::string_view(text, static_cast<size_t>(sqlite3_column_bytes(stmt, index)));
+	}
+
+	static inline std::string_view value(sqlite3_value * value) noexcept
+	{
+		const char * text = reinterpret_cast<const char *>(sqlite3_value_text(value));
+		return std::string_view(text, static_cast<size_t>(sqlite3_value_bytes(value)));
+	}
+
+	static inline void result(sqlite3_context * context, std::string_view value) noexcept
+		{ sqlite3_result_text(context, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT); }
+};
+
+// Empty optionals are bound as NULL, and NULL values are extracted as empty optionals.
+template <class T> struct SQLiteTraits<std::optional<T>>
+{
+	static inline int bind(sqlite3_stmt * stmt, int index, const std::optional<T> & value) noexcept
+		{ return value ? SQLiteTraits<T>::bind(stmt, index, *value) : sqlite3_bind_null(stmt, index); }
+
+	static inline std::optional<T> column(sqlite3_stmt * stmt, int index)
+	{
+		if (sqlite3_column_type(stmt, index) == SQLITE_NULL)
+			return std::nullopt;
+		return SQLiteTraits<T>::column(stmt, index);
+	}
+
+	static inline std::optional<T> value(sqlite3_value * value)
+	{
+		if (sqlite3_value_type(value) == SQLITE_NULL)
+			return std::nullopt;
+		return SQLiteTraits<T>::value(value);
+	}
+
+	static inline void result(sqlite3_context * context, const std::optional<T> & value)
+	{
+		if (!value)
+			sqlite3_result_null(context);
+		else
+			SQLiteTraits<T>::result(context, *value);
+	}
+};
+
+#endif
+
+// Helpers for expanding parameter packs into column / parameter indices.
+template <size_t... N> struct SQLiteIndices {};
+template <size_t COUNT, size_t... N> struct SQLiteMakeIndices : SQLiteMakeIndices<COUNT - 1, COUNT - 1, N...> {};
+template <size_t... N> struct SQLiteMakeIndices<0, N...> { typedef SQLiteIndices<N...> Type; };
+
+#endif
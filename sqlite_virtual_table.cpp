@@ -0,0 +1,191 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_virtual_table.h"
+#include <new>
+#include <cstring>
+
+namespace
+{
+	struct Table : public sqlite3_vtab
+	{
+		const SQLiteVirtualTable * impl;
+	};
+
+	struct TableCursor : public sqlite3_vtab_cursor
+	{
+		SQLiteVirtualTable::Cursor * impl;
+	};
+
+	int setError(sqlite3_vtab * vtab, const char * message) noexcept
+	{
+		sqlite3_free(vtab->zErrMsg);
+		vtab->zErrMsg = sqlite3_mprintf("%s", message);
+		return SQLITE_ERROR;
+	}
+
+	// Converts an exception thrown by the table into the result code of the xMethod callback. The message goes
+	// to zErrMsg, where SQLite picks it up as the error message of the statement that touched the table.
+	template <class FUNC> int guard(sqlite3_vtab * vtab, FUNC && body) noexcept
+	{
+		try
+		{
+			body();
+			return SQLITE_OK;
+		}
+		catch (const std::bad_alloc &)
+		{
+			return SQLITE_NOMEM;
+		}
+		catch (const std::exception & e)
+		{
+			return setError(vtab, e.what());
+		}
+		catch (...)
+		{
+			return setError(vtab, "unknown exception in virtual table.");
+		}
+	}
+
+	int xConnect(sqlite3 * db, void * aux, int, const char * const *, sqlite3_vtab ** vtab, char ** error)
+	{
+		const SQLiteVirtualTable * impl = reinterpret_cast<const SQLiteVirtualTable *>(aux);
+		try
+		{
+			int err = sqlite3_declare_vtab(db, impl->declaration().c_str());
+			if (err != SQLITE_OK)
+				return err;
+
+			Table * table = new Table;
+			memset(static_cast<sqlite3_vtab *>(table), 0, sizeof(sqlite3_vtab));
+			table->impl = impl;
+			*vtab = table;
+			return SQLITE_OK;
+		}
+		catch (const std::bad_alloc &)
+		{
+			return SQLITE_NOMEM;
+		}
+		catch (const std::exception & e)
+		{
+			*error = sqlite3_mprintf("%s", e.what());
+			return SQLITE_ERROR;
+		}
+	}
+
+	int xDisconnect(sqlite3_vtab * vtab)
+	{
+		delete static_cast<Table *>(vtab);
+		return SQLITE_OK;
+	}
+
+	int xBestIndex(sqlite3_vtab * vtab, sqlite3_index_info * info)
+	{
+		return guard(vtab, [vtab, info]() { static_cast<Table *>(vtab)->impl->bestIndex(info); });
+	}
+
+	int xOpen(sqlite3_vtab * vtab, sqlite3_vtab_cursor ** cursor)
+	{
+		return guard(vtab, [vtab, cursor]() {
+			TableCursor * tableCursor = new TableCursor;
+			tableCursor->impl = nullptr;
+			try
+			{
+				tableCursor->impl = static_cast<Table *>(vtab)->impl->openCursor();
+			}
+			catch (...)
+			{
+				delete tableCursor;
+				throw;
+			}
+			*cursor = tableCursor;
+		});
+	}
+
+	int xClose(sqlite3_vtab_cursor * cursor)
+	{
+		TableCursor * tableCursor = static_cast<TableCursor *>(cursor);
+		delete tableCursor->impl;
+		delete tableCursor;
+		return SQLITE_OK;
+	}
+
+	int xFilter(sqlite3_vtab_cursor * cursor, int plan, const char *, int argc, sqlite3_value ** argv)
+	{
+		return guard(cursor->pVtab, [cursor, plan, argc, argv]() {
+			static_cast<TableCursor *>(cursor)->impl->filter(plan, argc, argv);
+		});
+	}
+
+	int xNext(sqlite3_vtab_cursor * cursor)
+	{
+		return guard(cursor->pVtab, [cursor]() { static_cast<TableCursor *>(cursor)->impl->next(); });
+	}
+
+	int xEof(sqlite3_vtab_cursor * cursor)
+	{
+		return static_cast<TableCursor *>(cursor)->impl->eof() ? 1 : 0;
+	}
+
+	int xColumn(sqlite3_vtab_cursor * cursor, sqlite3_context * context, int index)
+	{
+		SQLiteFunctionGuard(context, [cursor, context, index]() {
+			static_cast<TableCursor *>(cursor)->impl->column(context, index);
+		});
+		return SQLITE_OK;
+	}
+
+	int xRowid(sqlite3_vtab_cursor * cursor, sqlite3_int64 * rowid)
+	{
+		return guard(cursor->pVtab, [cursor, rowid]() {
+			*rowid = static_cast<TableCursor *>(cursor)->impl->rowid();
+		});
+	}
+
+	sqlite3_module makeModule() noexcept
+	{
+		sqlite3_module module;
+		memset(&module, 0, sizeof(module));
+
+		// Eponymous-only: there is no xCreate, so the table exists as soon as the module is registered.
+		// There is no xUpdate, so the table is read-only.
+		module.xConnect = xConnect;
+		module.xBestIndex = xBestIndex;
+		module.xDisconnect = xDisconnect;
+		module.xDestroy = xDisconnect;
+		module.xOpen = xOpen;
+		module.xClose = xClose;
+		module.xFilter = xFilter;
+		module.xNext = xNext;
+		module.xEof = xEof;
+		module.xColumn = xColumn;
+		module.xRowid = xRowid;
+
+		return module;
+	}
+}
+
+sqlite3_module * SQLiteVirtualTable::module() noexcept
+{
+	static sqlite3_module module = makeModule();
+	return &module;
+}
@@ -0,0 +1,564 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __be65d2974cb9b4d883f7046593ed8d17__
+#define __be65d2974cb9b4d883f7046593ed8d17__
+
+#include "sqlite_function.h"
+#include "sqlite_traits.h"
+#include <yip-imports/sqlite3.h>
+#include <yip-imports/cxx-util/macros.h>
+#include <type_traits>
+#include <stdexcept>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <cmath>
+
+// Read-only virtual table, registered with SQLiteDatabase::createVirtualTable. The table is eponymous: it could
+// be queried by the name it was registered with, without CREATE VIRTUAL TABLE.
+class SQLiteVirtualTable
+{
+public:
+	class Cursor
+	{
+	public:
+		virtual ~Cursor() {}
+
+		// Positions the cursor at the first row of the plan chosen by `bestIndex`.
+		virtual void filter(int plan, int argc, sqlite3_value ** argv) = 0;
+		virtual bool eof() const = 0;
+		virtual void next() = 0;
+		virtual void column(sqlite3_context * context, int index) const = 0;
+		virtual sqlite3_int64 rowid() const = 0;
+	};
+
+	virtual ~SQLiteVirtualTable() {}
+
+	// Returns "CREATE TABLE x(...)" statement describing the columns.
+	virtual std::string declaration() const = 0;
+	virtual void bestIndex(sqlite3_index_info * info) const = 0;
+	virtual Cursor * openCursor() const = 0;
+
+private:
+	static sqlite3_module * module() noexcept;
+
+	friend class SQLiteDatabase;
+};
+
+// Maps C++ types to declared SQL types and compares their values with SQLite values. `rangeOf` returns -1 or 1
+// if the value is below or above the range of T, so that it could not be converted to T without wrapping.
+template <class T, class ENABLE = void> struct SQLiteTableColumnType
+{
+	static const char * name() noexcept { return ""; }
+	static bool isComparable(sqlite3_value *) noexcept { return false; }
+	static int compare(const T &, sqlite3_value *) noexcept { return 0; }
+	static int rangeOf(sqlite3_value *) noexcept { return 0; }
+};
+
+template <class T, bool = std::is_enum<T>::value> struct SQLiteTableIntegerType { typedef T Type; };
+template <class T> struct SQLiteTableIntegerType<T, true>
+	{ typedef typename std::underlying_type<T>::type Type; };
+
+template <class T> struct SQLiteTableColumnType<T, typename std::enable_if<std::is_integral<T>::value
+	|| std::is_enum<T>::value>::type>
+{
+	typedef typename SQLiteTableIntegerType<T>::Type Integer;
+
+	static const char * name() noexcept { return "INTEGER"; }
+	static bool isComparable(sqlite3_value * value) noexcept
+		{ return sqlite3_value_type(value) == SQLITE_INTEGER; }
+
+	// Values are compared as 64-bit integers, so they are not truncated to the range of T
+	static int compare(const T & a, sqlite3_value * value) noexcept
+		{ return compareInteger(Integer(a), sqlite3_value_int64(value), std::is_signed<Integer>()); }
+
+	static int rangeOf(sqlite3_value * value) noexcept
+	{
+		sqlite3_int64 b = sqlite3_value_int64(value);
+		if (std::is_signed<Integer>::value)
+		{
+			return (b < sqlite3_int64(std::numeric_limits<Integer>::min()) ? -1 :
+				(b > sqlite3_int64(std::numeric_limits<Integer>::max()) ? 1 : 0));
+		}
+		return (b < 0 ? -1 : (uint64_t(b) > uint64_t(std::numeric_limits<Integer>::max()) ? 1 : 0));
+	}
+
+private:
+	static int compareInteger(sqlite3_int64 a, sqlite3_int64 b, std::true_type) noexcept
+		{ return (a < b ? -1 : (b < a ? 1 : 0)); }
+	static int compareInteger(uint64_t a, sqlite3_int64 b, std::false_type) noexcept
+		{ return (b < 0 ? 1 : (a < uint64_t(b) ? -1 : (uint64_t(b) < a ? 1 : 0))); }
+};
+
+template <class T> struct SQLiteTableColumnType<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+	static const char * name() noexcept { return "REAL"; }
+	static bool isComparable(sqlite3_value * value) noexcept
+	{
+		int type = sqlite3_value_type(value);
+		return (type == SQLITE_FLOAT || type == SQLITE_INTEGER) && !std::isnan(sqlite3_value_double(value));
+	}
+	static int compare(const T & a, sqlite3_value * value) noexcept
+	{
+		double b = sqlite3_value_double(value);
+		return (double(a) < b ? -1 : (b < double(a) ? 1 : 0));
+	}
+	static int rangeOf(sqlite3_value *) noexcept { return 0; }
+};
+
+template <class T> struct SQLiteTableColumnType<T, typename std::enable_if<std::is_same<T, std::string>::value
+	|| std::is_same<T, const char *>::value || std::is_same<T, char *>::value>::type>
+{
+	static const char * name() noexcept { return "TEXT"; }
+	static bool isComparable(sqlite3_value * value) noexcept
+		{ return sqlite3_value_type(value) == SQLITE_TEXT; }
+	static int compare(const std::string & a, sqlite3_value * value) noexcept
+	{
+		const char * b = reinterpret_cast<const char *>(sqlite3_value_text(value));
+		size_t length = size_t(sqlite3_value_bytes(value));
+		int result = memcmp(a.data(), b, std::min(a.length(), length));
+		return (result != 0 ? result : (a.length() < length ? -1 : (a.length() > length ? 1 : 0)));
+	}
+	static int compare(const char * a, sqlite3_value * value) noexcept
+		{ return compare(std::string(a ? a : ""), value); }
+	static int rangeOf(sqlite3_value *) noexcept { return 0; }
+};
+
+// Accessors for columns of a virtual table whose rows are ELEMENTs. Values are converted with SQLiteTraits.
+template <class ELEMENT> class SQLiteTableColumns
+{
+public:
+	struct Column
+	{
+		std::string name;
+		const char * type;
+		std::function<void(sqlite3_context * context, const ELEMENT & element)> result;
+		std::function<bool(sqlite3_value * value)> isComparable;
+		std::function<int(const ELEMENT & element, sqlite3_value * value)> compare;
+		bool isKey;		// Column is the key of an element of an associative container
+	};
+
+	inline size_t size() const noexcept { return m_Columns.size(); }
+	inline const Column & operator[](size_t index) const noexcept { return m_Columns[index]; }
+
+	int indexOf(const char * name) const noexcept
+	{
+		for (size_t i = 0; i < m_Columns.size(); i++)
+		{
+			if (sqlite3_stricmp(m_Columns[i].name.c_str(), name) == 0)
+				return int(i);
+		}
+		return -1;
+	}
+
+	template <class T> SQLiteTableColumns & add(const char * name, T ELEMENT::* member)
+	{
+		add(name, [member](const ELEMENT & element) -> const T & { return element.*member; });
+		m_Columns.back().isKey = isFirstMember(member);
+		return *this;
+	}
+
+	// Adds the key of an element of an associative container: the element itself for sets and `first` for maps.
+	SQLiteTableColumns & addKey(const char * name)
+	{
+		add(name, [](const ELEMENT & element) -> decltype(keyOf(element)) { return keyOf(element); });
+		m_Columns.back().isKey = true;
+		return *this;
+	}
+
+	// `getter` should accept `const ELEMENT &` and return the value of the column.
+	template <class FUNC> SQLiteTableColumns & add(const char * name, FUNC getter)
+	{
+		typedef typename std::decay<typename SQLiteCallableTraits<FUNC>::Result>::type Type;
+		typedef SQLiteTableColumnType<Type> ColumnType;
+
+		Column column;
+		column.name = name;
+		column.type = ColumnType::name();
+		column.result = [getter](sqlite3_context * context, const ELEMENT & element) {
+			SQLiteTraits<Type>::result(context, getter(element));
+		};
+		column.isComparable = &ColumnType::isComparable;
+		column.compare = [getter](const ELEMENT & element, sqlite3_value * value) {
+			return ColumnType::compare(getter(element), value);
+		};
+		column.isKey = false;
+		m_Columns.emplace_back(std::move(column));
+
+		return *this;
+	}
+
+private:
+	std::vector<Column> m_Columns;
+
+	template <class T, class E> static bool isFirstMember(T E::*) noexcept { return false; }
+	template <class K, class V> static bool isFirstMember(K std::pair<K, V>::* member) noexcept
+		{ return member == &std::pair<K, V>::first; }
+
+	template <class E> static const E & keyOf(const E & element) noexcept { return element; }
+	template <class K, class V> static const K & keyOf(const std::pair<K, V> & element) noexcept
+		{ return element.first; }
+};
+
+// Lookups of rows by the key column. Sequence containers should be sorted by the key column in ascending order;
+// associative containers are searched by their keys, so their key column should be added with `addKey` or as a
+// pointer to `first`.
+template <class CONTAINER, class ENABLE = void> struct SQLiteContainerKeyLookup
+{
+	typedef typename CONTAINER::const_iterator Iterator;
+	typedef typename CONTAINER::value_type Element;
+	typedef typename SQLiteTableColumns<Element>::Column Column;
+
+	enum { IsAssociative = 0, SupportsRanges = 1, UniqueKeys = 0 };
+
+	static Iterator lowerBound(const CONTAINER & container, const Column & key, sqlite3_value * value)
+	{
+		return std::lower_bound(container.begin(), container.end(), value,
+			[&key](const Element & element, sqlite3_value * v) { return key.compare(element, v) < 0; });
+	}
+
+	static Iterator upperBound(const CONTAINER & container, const Column & key, sqlite3_value * value)
+	{
+		return std::upper_bound(container.begin(), container.end(), value,
+			[&key](sqlite3_value * v, const Element & element) { return key.compare(element, v) > 0; });
+	}
+
+	static std::pair<Iterator, Iterator> equalRange(const CONTAINER & container, const Column & key,
+		sqlite3_value * value)
+	{
+		return std::make_pair(lowerBound(container, key, value), upperBound(container, key, value));
+	}
+};
+
+template <class CONTAINER> struct SQLiteContainerKeyLookup<CONTAINER,
+	typename std::enable_if<sizeof(typename CONTAINER::key_type) != 0>::type>
+{
+	typedef typename CONTAINER::const_iterator Iterator;
+	typedef typename CONTAINER::value_type Element;
+	typedef typename CONTAINER::key_type Key;
+	typedef typename SQLiteTableColumns<Element>::Column Column;
+	typedef SQLiteTableColumnType<Key> KeyType;
+
+	template <class C> static auto hasRanges(int)
+		-> decltype(std::declval<const C &>().lower_bound(std::declval<Key>()), std::true_type());
+	template <class C> static std::false_type hasRanges(...);
+
+	// Multimaps and multisets return an iterator from `insert`, not a pair
+	template <class C> static auto hasUniqueKeys(int)
+		-> decltype(std::declval<C &>().insert(std::declval<const Element &>()).second, std::true_type());
+	template <class C> static std::false_type hasUniqueKeys(...);
+
+	enum
+	{
+		IsAssociative = 1,
+		SupportsRanges = decltype(hasRanges<CONTAINER>(0))::value,
+		UniqueKeys = decltype(hasUniqueKeys<CONTAINER>(0))::value,
+	};
+
+	typedef std::integral_constant<bool, SupportsRanges> HasRanges;
+
+	static Iterator lowerBound(const CONTAINER & container, const Column & key, sqlite3_value * value)
+	{
+		return bound(container, value, container.begin(), HasRanges(),
+			[&key, value](const Element & element) { return key.compare(element, value) < 0; });
+	}
+
+	static Iterator upperBound(const CONTAINER & container, const Column & key, sqlite3_value * value)
+	{
+		return bound(container, value, container.end(), HasRanges(),
+			[&key, value](const Element & element) { return key.compare(element, value) <= 0; });
+	}
+
+	static std::pair<Iterator, Iterator> equalRange(const CONTAINER & container, const Column & key,
+		sqlite3_value * value)
+	{
+		return equalRange(container, key, value, HasRanges());
+	}
+
+private:
+	// Returns the first element for which `before` is false. The key converted from the SQLite value could be
+	// rounded (e.g. for float keys), so the position found by the container is adjusted by comparing the
+	// original value. Unordered containers are never searched by ranges, `unordered` is returned for them.
+	template <class PRED> static Iterator bound(const CONTAINER & container, sqlite3_value * value, Iterator,
+		std::true_type, PRED before)
+	{
+		int range = KeyType::rangeOf(value);
+		if (range != 0)
+			return (range < 0 ? container.begin() : container.end());
+
+		Iterator it = container.lower_bound(SQLiteTraits<Key>::value(value));
+		while (it != container.end() && before(*it))
+			++it;
+		while (it != container.begin() && !before(*std::prev(it)))
+			--it;
+		return it;
+	}
+
+	template <class PRED> static Iterator bound(const CONTAINER &, sqlite3_value *, Iterator unordered,
+		std::false_type, PRED)
+	{
+		return unordered;
+	}
+
+	static std::pair<Iterator, Iterator> equalRange(const CONTAINER & container, const Column & key,
+		sqlite3_value * value, std::true_type)
+	{
+		return std::make_pair(lowerBound(container, key, value), upperBound(container, key, value));
+	}
+
+	static std::pair<Iterator, Iterator> equalRange(const CONTAINER & container, const Column & key,
+		sqlite3_value * value, std::false_type)
+	{
+		if (KeyType::rangeOf(value) != 0)
+			return std::make_pair(container.end(), container.end());
+
+		auto range = container.equal_range(SQLiteTraits<Key>::value(value));
+		if (range.first != range.second && key.compare(*range.first, value) != 0)
+			return std::make_pair(container.end(), container.end());
+		return range;
+	}
+};
+
+// Exposes a C++ container as a read-only table. The container is referenced, not copied: it should outlive the
+// database connection and should not be modified while queries are running. If `keyColumn` is specified,
+// equality and range constraints on it are resolved with lookups instead of a full scan. Rowid of a row is the
+// position of its element in the container.
+//
+// Example:
+//   SQLiteTableColumns<Item> columns;
+//   columns.add("id", &Item::id).add("name", &Item::name);
+//   db.createVirtualTable("items", std::unique_ptr<SQLiteVirtualTable>(
+//       new SQLiteContainerTable<std::vector<Item>>(items, columns, "id")));
+template <class CONTAINER> class SQLiteContainerTable : public SQLiteVirtualTable
+{
+public:
+	typedef typename CONTAINER::value_type Element;
+	typedef typename CONTAINER::const_iterator Iterator;
+	typedef SQLiteContainerKeyLookup<CONTAINER> Lookup;
+
+	SQLiteContainerTable(const CONTAINER & container, const SQLiteTableColumns<Element> & columns,
+			const char * keyColumn = nullptr)
+		: m_Container(container),
+		  m_Columns(columns),
+		  m_KeyColumn(keyColumn ? columns.indexOf(keyColumn) : -1)
+	{
+		if (UNLIKELY(keyColumn && m_KeyColumn < 0))
+			throw std::runtime_error(std::string("key column '") + keyColumn + "' does not exist.");
+		if (UNLIKELY(Lookup::IsAssociative && m_KeyColumn >= 0 && !columns[size_t(m_KeyColumn)].isKey))
+		{
+			throw std::runtime_error(std::string("key column '") + keyColumn
+				+ "' is not the key of the container.");
+		}
+	}
+
+	std::string declaration() const override
+	{
+		std::string sql = "CREATE TABLE x(";
+		for (size_t i = 0; i < m_Columns.size(); i++)
+		{
+			if (i > 0)
+				sql += ", ";
+			sql += '"';
+			sql += m_Columns[i].name;
+			sql += "\" ";
+			sql += m_Columns[i].type;
+		}
+		sql += ')';
+		return sql;
+	}
+
+	void bestIndex(sqlite3_index_info * info) const override
+	{
+		int eq = -1, lower = -1, upper = -1, plan = 0;
+		for (int i = 0; m_KeyColumn >= 0 && i < info->nConstraint; i++)
+		{
+			const sqlite3_index_info::sqlite3_index_constraint & constraint = info->aConstraint[i];
+			if (!constraint.usable || constraint.iColumn != m_KeyColumn)
+				continue;
+
+			// Containers are ordered by binary comparison, so e.g. "key = 'abc' COLLATE NOCASE" needs a full scan
+			const char * collation = sqlite3_vtab_collation(info, i);
+			if (collation && sqlite3_stricmp(collation, "BINARY") != 0)
+				continue;
+
+			switch (constraint.op)
+			{
+			case SQLITE_INDEX_CONSTRAINT_EQ:
+				if (eq < 0) { eq = i; plan = PlanEq; }
+				break;
+			case SQLITE_INDEX_CONSTRAINT_GT:
+			case SQLITE_INDEX_CONSTRAINT_GE:
+				if (Lookup::SupportsRanges && lower < 0)
+				{
+					lower = i;
+					plan |= (constraint.op == SQLITE_INDEX_CONSTRAINT_GT ? PlanGt : PlanGe);
+				}
+				break;
+			case SQLITE_INDEX_CONSTRAINT_LT:
+			case SQLITE_INDEX_CONSTRAINT_LE:
+				if (Lookup::SupportsRanges && upper < 0)
+				{
+					upper = i;
+					plan |= (constraint.op == SQLITE_INDEX_CONSTRAINT_LT ? PlanLt : PlanLe);
+				}
+				break;
+			}
+		}
+
+		// SQLite re-checks all constraints, so lookups only have to narrow the range of rows
+		double numRows = double(std::max<size_t>(m_Container.size(), 1));
+		if (eq >= 0)
+		{
+			plan = PlanEq;
+			info->aConstraintUsage[eq].argvIndex = 1;
+			info->estimatedCost = std::log2(numRows) + 1.0;
+			info->estimatedRows = 1;
+			if (Lookup::UniqueKeys)
+				info->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
+		}
+		else
+		{
+			int argc = 0;
+			if (lower >= 0)
+				info->aConstraintUsage[lower].argvIndex = ++argc;
+			if (upper >= 0)
+				info->aConstraintUsage[upper].argvIndex = ++argc;
+			info->estimatedCost = (argc == 0 ? numRows : std::log2(numRows) + numRows / (argc == 2 ? 8.0 : 3.0));
+			info->estimatedRows = sqlite3_int64(argc == 0 ? numRows : numRows / (argc == 2 ? 8.0 : 3.0));
+		}
+		info->idxNum = plan;
+
+		// Ordered containers return rows sorted by the key. SQLite passes only ORDER BY terms using the collation
+		// of the column, which is BINARY as the declaration does not specify any.
+		if (m_KeyColumn >= 0 && Lookup::SupportsRanges && info->nOrderBy == 1
+				&& info->aOrderBy[0].iColumn == m_KeyColumn && !info->aOrderBy[0].desc)
+			info->orderByConsumed = 1;
+	}
+
+	Cursor * openCursor() const override { return new ContainerCursor(*this); }
+
+private:
+	enum
+	{
+		PlanEq = 1,
+		PlanGt = 2,
+		PlanGe = 4,
+		PlanLt = 8,
+		PlanLe = 16,
+	};
+
+	class ContainerCursor : public Cursor
+	{
+	public:
+		explicit ContainerCursor(const SQLiteContainerTable & table) : m_Table(table), m_RowId(-1) {}
+
+		void filter(int plan, int argc, sqlite3_value ** argv) override
+		{
+			const CONTAINER & container = m_Table.m_Container;
+			m_Current = container.begin();
+			m_End = container.end();
+			m_RowId = -1;
+
+			if (plan == 0 || argc == 0)
+				return;
+
+			// Values of other types are compared by SQLite itself, so the whole range is scanned for them
+			const auto & key = m_Table.m_Columns[size_t(m_Table.m_KeyColumn)];
+			int arg = 0;
+			if (plan & PlanEq)
+			{
+				if (key.isComparable(argv[0]))
+				{
+					auto range = Lookup::equalRange(container, key, argv[0]);
+					m_Current = range.first;
+					m_End = range.second;
+				}
+				return;
+			}
+
+			if (plan & (PlanGt | PlanGe))
+			{
+				sqlite3_value * value = argv[arg++];
+				if (key.isComparable(value))
+				{
+					m_Current = (plan & PlanGt ? Lookup::upperBound(container, key, value)
+						: Lookup::lowerBound(container, key, value));
+				}
+			}
+
+			if (plan & (PlanLt | PlanLe))
+			{
+				sqlite3_value * value = argv[arg++];
+				if (key.isComparable(value))
+				{
+					// Lower bound could be past the upper one, e.g. for "key > 10 AND key < 5"
+					int order = (m_Current != m_End ? key.compare(*m_Current, value) : 0);
+					if (order > 0 || (order == 0 && (plan & PlanLt)))
+						m_End = m_Current;
+					else
+					{
+						m_End = (plan & PlanLt ? Lookup::lowerBound(container, key, value)
+							: Lookup::upperBound(container, key, value));
+					}
+				}
+			}
+		}
+
+		bool eof() const override { return m_Current == m_End; }
+		void next() override
+		{
+			++m_Current;
+			if (m_RowId >= 0)
+				++m_RowId;
+		}
+
+		// Position is counted only when requested: it is linear for containers without random access iterators
+		sqlite3_int64 rowid() const override
+		{
+			if (m_RowId < 0)
+				m_RowId = sqlite3_int64(std::distance(m_Table.m_Container.begin(), m_Current));
+			return m_RowId;
+		}
+
+		void column(sqlite3_context * context, int index) const override
+			{ m_Table.m_Columns[size_t(index)].result(context, *m_Current); }
+
+	private:
+		const SQLiteContainerTable & m_Table;
+		Iterator m_Current;
+		Iterator m_End;
+		mutable sqlite3_int64 m_RowId;
+	};
+
+	const CONTAINER & m_Container;
+	SQLiteTableColumns<Element> m_Columns;
+	int m_KeyColumn;
+};
+
+#endif
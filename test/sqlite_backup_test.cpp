@@ -0,0 +1,63 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_test.h"
+#include "../sqlite_backup.h"
+#include <yip-imports/cxx-util/fmt.h>
+
+// Modifications of the source by another connection restart the backup from the first page.
+void testBackup()
+{
+	std::string sourceFile = temporaryFile("sqlite_backup_test.db");
+	{
+		SQLiteDatabase source(sourceFile);
+		source.exec("PRAGMA page_size = 4096");
+		source.exec("CREATE TABLE t (id INTEGER PRIMARY KEY, data BLOB)");
+		source.transaction([&source]() {
+			for (int i = 0; i < 95; i++)
+				source.exec("INSERT INTO t (data) VALUES (zeroblob(3000))");
+		});
+
+		SQLiteDatabase other(sourceFile);
+		SQLiteDatabase destination(":memory:");
+
+		SQLiteBackup::Options options;
+		options.pagesPerStep = 64;
+		SQLiteBackup backup(source, destination, options);
+
+		expect(!backup.step(), "backup has completed in one step.");
+		expect(backup.progress().remainingPages > 0 && backup.progress().remainingPages < options.pagesPerStep,
+			fmt() << "unexpected number of remaining pages: " << backup.progress().remainingPages);
+
+		// Size of the database does not change, so the restarted step leaves as many pages as before it
+		other.exec("UPDATE t SET data = zeroblob(2000) WHERE id = 1");
+		expect(backup.run(), "backup has been aborted.");
+
+		const SQLiteBackup::Progress & progress = backup.progress();
+		expect(progress.restarts == 1, fmt() << "expected one restart, got " << progress.restarts);
+		expect(progress.pagesCopied == uint64_t(options.pagesPerStep + progress.totalPages),
+			fmt() << "copied " << progress.pagesCopied << " pages, total " << progress.totalPages);
+		expectRows(destination, "SELECT count(*) FROM t", "95");
+		expectRows(destination, "SELECT length(data) FROM t WHERE id = 1", "2000");
+	}
+	remove(sourceFile.c_str());
+}
@@ -0,0 +1,153 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_test.h"
+#include "../sqlite_blob.h"
+#include "../sqlite_statement.h"
+#include <functional>
+#include <cstring>
+
+namespace
+{
+	const size_t BlobSize = 100003;
+	const size_t ChunkSize = 4096;
+
+	inline unsigned char pattern(size_t offset) noexcept
+	{
+		return static_cast<unsigned char>(offset * 31 + offset / 251);
+	}
+
+	// Returns message of the exception thrown by `body`, or an empty string.
+	std::string errorOf(const std::function<void()> & body)
+	{
+		try
+		{
+			body();
+		}
+		catch (const std::exception & e)
+		{
+			return e.what();
+		}
+		return std::string();
+	}
+
+	inline bool contains(const std::string & str, const char * substr) noexcept
+	{
+		return str.find(substr) != std::string::npos;
+	}
+}
+
+// A zeroblob is filled and read back in chunks, and `reopen` walks over rows. A handle that failed to reopen
+// reports that it is unusable rather than expired.
+void testBlob()
+{
+	SQLiteDatabase db(":memory:");
+	db.exec("CREATE TABLE media (id INTEGER PRIMARY KEY, data BLOB)");
+
+	SQLiteStatement insert(db, "INSERT INTO media (data) VALUES (?)");
+	insert.bindZeroBlob(1, BlobSize);
+	insert.exec();
+	sqlite3_int64 rowid = db.lastInsertId();
+
+	{
+		SQLiteBlob blob(db, "media", "data", rowid, SQLiteBlob::ReadWrite);
+		expect(blob.size() == BlobSize, fmt() << "unexpected size of the zeroblob: " << blob.size());
+
+		size_t produced = 0, calls = 0;
+		size_t written = blob.writeChunks([&produced, &calls](void * buffer, size_t size) -> size_t {
+			expect(size <= ChunkSize, fmt() << "source was asked for " << size << " bytes.");
+			for (size_t i = 0; i < size; i++)
+				static_cast<unsigned char *>(buffer)[i] = pattern(produced + i);
+			produced += size;
+			++calls;
+			return size;
+		}, ChunkSize);
+		expect(written == BlobSize, fmt() << "wrote " << written << " bytes.");
+		expect(calls == (BlobSize + ChunkSize - 1) / ChunkSize, fmt() << "source was called " << calls
+			<< " times.");
+		expect(blob.position() == BlobSize, "position is not at the end of the blob.");
+
+		expect(contains(errorOf([&blob]() { blob.write("x", 1); }), "outside of blob"),
+			"write past the end of the blob did not fail.");
+	}
+
+	{
+		SQLiteBlob blob(db, "media", "data", rowid);
+		blob.seek(ChunkSize / 2);
+
+		size_t offset = ChunkSize / 2, chunks = 0;
+		bool matches = true;
+		blob.readChunks([&offset, &chunks, &matches](const void * data, size_t size) {
+			for (size_t i = 0; i < size; i++)
+				matches = matches && static_cast<const unsigned char *>(data)[i] == pattern(offset + i);
+			offset += size;
+			++chunks;
+		}, ChunkSize);
+		expect(matches, "data read back does not match the data written.");
+		expect(offset == BlobSize, fmt() << "read up to offset " << offset);
+		expect(chunks == (BlobSize - ChunkSize / 2 + ChunkSize - 1) / ChunkSize, fmt() << "read " << chunks
+			<< " chunks.");
+
+		unsigned char last = 0;
+		expect(blob.read(&last, 1) == 0, "read at the end of the blob returned data.");
+		blob.readAt(BlobSize - 1, &last, 1);
+		expect(last == pattern(BlobSize - 1), "unexpected last byte of the blob.");
+	}
+
+	db.transaction([&insert]() {
+		for (int i = 1; i <= 10; i++)
+		{
+			insert.bindBlob(1, &i, sizeof(i));
+			insert.exec();
+		}
+	});
+
+	SQLiteBlob blob(db, "media", "data", rowid + 1);
+	int sum = 0;
+	for (sqlite3_int64 id = rowid + 1; id <= rowid + 10; id++)
+	{
+		blob.reopen(id);
+		expect(blob.size() == sizeof(int) && blob.position() == 0, "reopen did not reset size and position.");
+		int value = 0;
+		blob.read(&value, sizeof(value));
+		sum += value;
+	}
+	expect(sum == 55, fmt() << "sum of values read after reopen is " << sum);
+
+	db.exec(fmt() << "UPDATE media SET data = x'00' WHERE id = " << rowid + 10);
+	int value = 0;
+	std::string error = errorOf([&blob, &value]() { blob.readAt(0, &value, sizeof(value)); });
+	expect(contains(error, "expired"), "modification of the row did not expire the blob: " + error);
+
+	SQLiteBlob other(db, "media", "data", rowid + 1);
+	error = errorOf([&other, rowid]() { other.reopen(rowid + 100); });
+	expect(contains(error, "unable to open blob"), "reopen for a missing row did not fail: " + error);
+	expect(!contains(error, "expired"), "failed reopen is reported as an expired blob: " + error);
+
+	error = errorOf([&other, &value]() { other.readAt(0, &value, sizeof(value)); });
+	expect(contains(error, "unusable after a failed reopen"), "unexpected error after a failed reopen: " + error);
+	error = errorOf([&other, rowid]() { other.reopen(rowid + 1); });
+	expect(contains(error, "unusable after a failed reopen"), "handle was reopened after a failed reopen: "
+		+ error);
+	error = errorOf([&other]() { other.readChunks([](const void *, size_t) {}); });
+	expect(contains(error, "unusable after a failed reopen"), "readChunks succeeded after a failed reopen.");
+}
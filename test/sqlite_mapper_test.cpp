@@ -0,0 +1,130 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_test.h"
+#include "../sqlite_mapper.h"
+#include <vector>
+
+struct MappedPerson
+{
+	sqlite3_int64 id;
+	std::string name;
+	double score;
+};
+
+SQLITE_MAPPED_TYPE(MappedPerson, "mapped \"people\"",
+	SQLITE_FIELD(id),
+	SQLITE_FIELD_NAMED(name, "full \"name\""),
+	SQLITE_FIELD(score));
+
+namespace
+{
+	MappedPerson person(sqlite3_int64 id, const char * name, double score)
+	{
+		MappedPerson result;
+		result.id = id;
+		result.name = name;
+		result.score = score;
+		return result;
+	}
+
+	const char * const g_Names = "SELECT \"full \"\"name\"\"\" FROM \"mapped \"\"people\"\"\" ORDER BY id";
+}
+
+// Table and column names are quoted, `replace` overwrites the row, and a failing row rolls back the whole bulk
+// insert (only its savepoint inside of an outer transaction).
+void testMapper()
+{
+	typedef SQLiteMapper<MappedPerson> Mapper;
+
+	expect(Mapper::insertSQL() == "INSERT INTO \"mapped \"\"people\"\"\" "
+		"(\"id\", \"full \"\"name\"\"\", \"score\") VALUES (?, ?, ?)",
+		"unexpected insert SQL: " + Mapper::insertSQL());
+	expect(Mapper::selectSQL() == "SELECT \"id\", \"full \"\"name\"\"\", \"score\" FROM \"mapped \"\"people\"\"\"",
+		"unexpected select SQL: " + Mapper::selectSQL());
+
+	SQLiteDatabase db(":memory:");
+	db.exec("CREATE TABLE \"mapped \"\"people\"\"\" (id INTEGER PRIMARY KEY, \"full \"\"name\"\"\" TEXT UNIQUE, "
+		"score REAL)");
+	Mapper people(db);
+
+	expect(people.insert(person(1, "alice", 4.5)) == 1, "unexpected rowid of the inserted row.");
+	expect(people.insert(person(2, "bob", 3.0)) == 2, "unexpected rowid of the inserted row.");
+
+	std::vector<MappedPerson> all = people.selectAll();
+	expect(all.size() == 2 && all[0].name == "alice" && all[0].score == 4.5 && all[1].id == 2,
+		"rows were not read back.");
+
+	people.replace(person(1, "alice", 9.5));
+	expect(people.count() == 2, fmt() << "expected 2 rows after replace, got " << people.count());
+	std::vector<MappedPerson> alice = people.selectWhere("\"full \"\"name\"\"\" = ?", "alice");
+	expect(alice.size() == 1 && alice[0].score == 9.5, "replace did not update the row.");
+
+	bool failed = false;
+	try
+	{
+		people.insert(person(1, "carol", 1.0));
+	}
+	catch (const std::exception &)
+	{
+		failed = true;
+	}
+	expect(failed, "duplicate primary key was inserted.");
+
+	std::vector<MappedPerson> bulk;
+	bulk.push_back(person(3, "carol", 1.0));
+	bulk.push_back(person(4, "dave", 2.0));
+	bulk.push_back(person(5, "bob", 3.0));
+	bulk.push_back(person(6, "eve", 4.0));
+
+	failed = false;
+	try
+	{
+		people.insert(bulk);
+	}
+	catch (const std::exception &)
+	{
+		failed = true;
+	}
+	expect(failed, "bulk insert did not fail on the duplicate name.");
+	expectRows(db, g_Names, "alice,bob");
+
+	failed = false;
+	db.transaction([&people, &bulk, &failed]() {
+		people.insert(person(7, "frank", 5.0));
+		try
+		{
+			people.insert(bulk);
+		}
+		catch (const std::exception &)
+		{
+			failed = true;
+		}
+	});
+	expect(failed, "nested bulk insert did not fail on the duplicate name.");
+	expectRows(db, g_Names, "alice,bob,frank");
+
+	bulk[2].name = "grace";
+	expect(people.insert(bulk) == 4, "unexpected number of inserted rows.");
+	expect(people.count("score < ?", 3.0) == 2, "unexpected count of filtered rows.");
+	expectRows(db, g_Names, "alice,bob,carol,dave,grace,eve,frank");
+}
@@ -0,0 +1,63 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_test.h"
+#include <iostream>
+#include <exception>
+
+namespace
+{
+	struct Test
+	{
+		const char * name;
+		void (* run)();
+	};
+
+	const Test g_Tests[] = {
+		{ "backup", testBackup },
+		{ "blob", testBlob },
+		{ "mapper", testMapper },
+		{ "virtual tables", testVirtualTables },
+	};
+}
+
+bool runSQLiteTests()
+{
+	size_t numFailed = 0;
+	for (const Test & test : g_Tests)
+	{
+		try
+		{
+			test.run();
+			std::cout << "passed: " << test.name << std::endl;
+		}
+		catch (const std::exception & e)
+		{
+			std::cout << "FAILED: " << test.name << ": " << e.what() << std::endl;
+			++numFailed;
+		}
+	}
+
+	std::cout << (sizeof(g_Tests) / sizeof(g_Tests[0]) - numFailed) << " passed, " << numFailed << " failed."
+		<< std::endl;
+	return numFailed == 0;
+}
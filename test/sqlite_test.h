@@ -0,0 +1,81 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#ifndef __c66bc81f47129469c6480befc2e07274__
+#define __c66bc81f47129469c6480befc2e07274__
+
+#include "../sqlite_database.h"
+#include <yip-imports/cxx-util/macros.h>
+#include <yip-imports/cxx-util/fmt.h>
+#include <stdexcept>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+
+// Tests throw std::runtime_error on failure.
+void testBackup();
+void testBlob();
+void testMapper();
+void testVirtualTables();
+
+// Runs all tests, printing their results. Returns false if any of them has failed.
+bool runSQLiteTests();
+
+inline void expect(bool condition, const std::string & message)
+{
+	if (UNLIKELY(!condition))
+		throw std::runtime_error(message);
+}
+
+// Returns path of a file in the temporary directory; the file is deleted if it exists.
+inline std::string temporaryFile(const char * name)
+{
+	const char * directory = getenv("TMPDIR");
+	std::string path = (directory && *directory ? directory : "/tmp");
+	if (path[path.length() - 1] != '/')
+		path += '/';
+	path += name;
+	remove(path.c_str());
+	return path;
+}
+
+// Returns values of the first column of all rows, separated by commas.
+inline std::string selectText(SQLiteDatabase & db, const char * sql)
+{
+	std::string result;
+	db.exec(sql, [&result](const SQLiteCursor & cursor) {
+		if (!result.empty())
+			result += ',';
+		const char * text = cursor.toText(0);
+		result += (text ? text : "NULL");
+	});
+	return result;
+}
+
+inline void expectRows(SQLiteDatabase & db, const char * sql, const char * expected)
+{
+	std::string result = selectText(db, sql);
+	if (UNLIKELY(result != expected))
+		throw std::runtime_error(fmt() << sql << ": expected '" << expected << "', got '" << result << "'.");
+}
+
+#endif
@@ -0,0 +1,127 @@
+/* vim: set ai noet ts=4 sw=4 tw=115: */
+//
+// Copyright (c) 2014 Nikolay Zapolnov (zapolnov@gmail.com).
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "sqlite_test.h"
+#include "../sqlite_virtual_table.h"
+#include <stdexcept>
+#include <memory>
+#include <vector>
+#include <string>
+#include <map>
+
+namespace
+{
+	struct Item
+	{
+		int id;
+		unsigned u;
+		std::string name;
+	};
+
+	template <class CONTAINER> void createTable(SQLiteDatabase & db, const char * name, const CONTAINER & data,
+		const SQLiteTableColumns<typename CONTAINER::value_type> & columns, const char * keyColumn)
+	{
+		db.createVirtualTable(name, std::unique_ptr<SQLiteVirtualTable>(
+			new SQLiteContainerTable<CONTAINER>(data, columns, keyColumn)));
+	}
+}
+
+// Lookups by the key column should return the same rows as a full scan.
+void testVirtualTables()
+{
+	SQLiteDatabase db(":memory:");
+
+	std::vector<Item> items = { { 1, 1, "a" }, { 3, 3, "b" }, { 5, 5, "c" }, { 7, 7, "d" }, { 9, 9, "e" } };
+	SQLiteTableColumns<Item> itemColumns;
+	itemColumns.add("id", &Item::id).add("u", &Item::u).add("name", &Item::name);
+	createTable(db, "items", items, itemColumns, "id");
+	createTable(db, "unsigned_items", items, itemColumns, "u");
+
+	expectRows(db, "SELECT name FROM items WHERE id > 2 AND id <= 7", "b,c,d");
+	expectRows(db, "SELECT name FROM items WHERE id > 7 AND id < 3", "");
+
+	// Values out of range of the key type should not be truncated
+	expectRows(db, "SELECT name FROM items WHERE id < 4294967297", "a,b,c,d,e");
+	expectRows(db, "SELECT name FROM items WHERE id > 4294967296", "");
+	expectRows(db, "SELECT name FROM items WHERE id = 4294967299", "");
+	expectRows(db, "SELECT name FROM unsigned_items WHERE u > -1", "a,b,c,d,e");
+	expectRows(db, "SELECT name FROM unsigned_items WHERE u = -4294967293", "");
+
+	// Rowid is the position of the element in the container
+	expectRows(db, "SELECT rowid FROM items WHERE id >= 5", "2,3,4");
+	expectRows(db, "SELECT rowid FROM items WHERE id = 3", "1");
+
+	typedef std::map<std::string, int> Map;
+	Map map = { { "x", 1 }, { "y", 2 }, { "z", 2 } };
+	SQLiteTableColumns<Map::value_type> mapColumns;
+	mapColumns.addKey("k").add("v", &Map::value_type::second);
+	createTable(db, "map", map, mapColumns, "k");
+
+	expectRows(db, "SELECT v FROM map WHERE k = 'y'", "2");
+	expectRows(db, "SELECT k FROM map WHERE k > 'x'", "y,z");
+	expectRows(db, "SELECT rowid FROM map WHERE k = 'z'", "2");
+
+	// Lookups compare keys as binary strings, so constraints with other collations are resolved by a full scan
+	expectRows(db, "SELECT v FROM map WHERE k = 'Y' COLLATE NOCASE", "2");
+	expectRows(db, "SELECT k FROM map WHERE k > 'X' COLLATE NOCASE ORDER BY k", "y,z");
+	expectRows(db, "SELECT k FROM map WHERE k < 'Y' COLLATE NOCASE", "x");
+
+	Map mixedCase = { { "B", 1 }, { "a", 2 }, { "c", 3 } };
+	createTable(db, "mixed_case", mixedCase, mapColumns, "k");
+
+	expectRows(db, "SELECT k FROM mixed_case WHERE k = 'b' COLLATE NOCASE", "B");
+	expectRows(db, "SELECT k FROM mixed_case WHERE k >= 'A' COLLATE NOCASE", "B,a,c");
+	expectRows(db, "SELECT k FROM mixed_case ORDER BY k", "B,a,c");
+	expectRows(db, "SELECT k FROM mixed_case ORDER BY k COLLATE NOCASE", "a,B,c");
+
+	// Associative containers are sorted by their keys only
+	bool thrown = false;
+	try
+	{
+		createTable(db, "map_by_value", map, mapColumns, "v");
+	}
+	catch (const std::runtime_error &)
+	{
+		thrown = true;
+	}
+	expect(thrown, "mapped value was accepted as the key column.");
+
+	typedef std::multimap<short, int> MultiMap;
+	MultiMap multiMap = { { 1, 10 }, { 1, 11 }, { 2, 20 } };
+	SQLiteTableColumns<MultiMap::value_type> multiMapColumns;
+	multiMapColumns.add("k", &MultiMap::value_type::first).add("v", &MultiMap::value_type::second);
+	createTable(db, "multimap", multiMap, multiMapColumns, "k");
+
+	expectRows(db, "SELECT v FROM multimap WHERE k = 1", "10,11");
+	expectRows(db, "SELECT v FROM multimap WHERE k = 65537", "");
+	expectRows(db, "SELECT v FROM multimap WHERE k < 65537", "10,11,20");
+
+	// Keys converted from SQLite values could be rounded
+	typedef std::map<float, int> FloatMap;
+	FloatMap floatMap = { { 1.0f, 1 }, { 1.1f, 2 } };
+	SQLiteTableColumns<FloatMap::value_type> floatMapColumns;
+	floatMapColumns.addKey("k").add("v", &FloatMap::value_type::second);
+	createTable(db, "float_map", floatMap, floatMapColumns, "k");
+
+	expectRows(db, "SELECT v FROM float_map WHERE k > 1.1", "2");
+	expectRows(db, "SELECT v FROM float_map WHERE k <= 1.1", "1");
+}
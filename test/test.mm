@@ -21,6 +21,7 @@
 // THE SOFTWARE.
 //
 #import "../apple/sqlite_database.h"
+#import "sqlite_test.h"
 
 @interface MyObject : NSObject
 @property (nonatomic, copy) NSString * string;
@@ -58,6 +59,9 @@ int main()
 {
 	@autoreleasepool
 	{
+		if (!runSQLiteTests())
+			return 1;
+
 		Class className = [MyObject class];
 
 		// Drop table